@@ -2,20 +2,17 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <sys/wait.h>
 
-#define TRUE 1
-#define FALSE 0
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+#include "sample_ring.h"
+#include "trace.h"
+
 #define NUM_SAMPLES 1000
 #define NUM_FORK_TESTS 10
 #define TIMING_ITERATIONS 1000
 
-static inline uint64_t get_system_time() {
-    uint64_t time;
-    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
-    return time;
-}
-
 static inline uint64_t time_diff() {
     uint64_t start, end;
     start = get_system_time();
@@ -23,110 +20,165 @@ static inline uint64_t time_diff() {
         // This loop is to ensure we measure a non-zero time difference
     }
     end = get_system_time();
-    return end - start;
-}
-
-static inline void get_cpu_info(char* vendor) {
-    uint64_t midr;
-    asm volatile("mrs %0, midr_el1" : "=r" (midr));
-    
-    uint8_t implementer = (midr >> 24) & 0xFF;
-    uint8_t variant = (midr >> 20) & 0xF;
-    uint8_t architecture = (midr >> 16) & 0xF;
-    uint16_t part_num = (midr >> 4) & 0xFFF;
-    
-    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
+    return bench_elapsed(start, end, FALSE);
 }
 
-void cpu_timing_test(uint64_t *results, int num_samples) {
-    for (int i = 0; i < num_samples; i++) {
-        results[i] = time_diff();
+static inline uint64_t time_diff_serialized() {
+    uint64_t start, end;
+    start = get_system_time_start();
+    for (volatile int i = 0; i < TIMING_ITERATIONS; i++) {
+        // This loop is to ensure we measure a non-zero time difference
     }
+    end = get_system_time_end();
+    return bench_elapsed(start, end, TRUE);
 }
 
-int cpu_hv() {
-    uint64_t id_aa64pfr0;
-    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
-    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
-}
-
-void cpu_write_vendor(char* vendor) {
-    get_cpu_info(vendor);
+// With a trace, every sample is also written to it, outside the timed interval
+void cpu_timing_test(Histogram *hist, int num_samples, int serialized, Trace *trace, int series) {
+    // Pick the variant outside the loop so samples carry no extra branch
+    if (serialized) {
+        for (int i = 0; i < num_samples; i++) {
+            uint64_t sample = time_diff_serialized();
+            hist_record(hist, sample);
+            if (trace != NULL) {
+                trace_record(trace, get_system_time(), TRACE_KIND_SAMPLE, series, sample);
+            }
+        }
+    } else {
+        for (int i = 0; i < num_samples; i++) {
+            uint64_t sample = time_diff();
+            hist_record(hist, sample);
+            if (trace != NULL) {
+                trace_record(trace, get_system_time(), TRACE_KIND_SAMPLE, series, sample);
+            }
+        }
+    }
 }
 
-uint64_t measure_fork_time() {
-    uint64_t start, end;
-    pid_t pid;
+static Histogram phase_hist[FORK_NUM_PHASES];
+static Trace trace;
+static Trace *tracing;
+static int phase_series[FORK_NUM_PHASES];
 
-    start = get_system_time();
-    pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        _exit(0);
-    } else if (pid > 0) {
-        // Parent process
-        wait(NULL);
-        end = get_system_time();
-        return end - start;
-    } else {
-        // Fork failed
-        perror("fork");
-        return 0;
+// Runs on the reporter thread, so printing never lands between two forks
+static void report_fork_sample(const SampleRecord *rec, void *arg) {
+    hist_record(&phase_hist[rec->kind], rec->value);
+    if (rec->kind == FORK_PHASE_TOTAL) {
+        printf("Fork test %u: %.6f ms\n", rec->source + 1, ticks_to_ms(rec->value));
+    }
+    if (tracing != NULL) {
+        trace_record(tracing, rec->timestamp, TRACE_KIND_SAMPLE, phase_series[rec->kind], rec->value);
     }
 }
 
-void print_timing_stats(uint64_t *results, int num_samples, double cntfrq_mhz) {
-    uint64_t min = UINT64_MAX, max = 0, sum = 0;
-    int non_zero_count = 0;
-
-    for (int i = 0; i < num_samples; i++) {
-        if (results[i] > 0) {
-            if (results[i] < min) min = results[i];
-            if (results[i] > max) max = results[i];
-            sum += results[i];
-            non_zero_count++;
+int main(int argc, char **argv) {
+    static Histogram timing_hist;
+    int dump_buckets = FALSE;
+    int serialized = FALSE;
+    const char *trace_path = NULL;
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+    WarmupResult warmup;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            serialized = TRUE;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
         }
     }
 
-    printf("Timing Statistics:\n");
-    printf("  Samples: %d\n", num_samples);
-    printf("  Non-zero samples: %d\n", non_zero_count);
-    if (non_zero_count > 0) {
-        printf("  Minimum: %.6f ms\n", min / (cntfrq_mhz * 1000));
-        printf("  Maximum: %.6f ms\n", max / (cntfrq_mhz * 1000));
-        printf("  Average: %.6f ms\n", (sum / non_zero_count) / (cntfrq_mhz * 1000));
-        printf("  Average per iteration: %.9f ms\n", ((sum / non_zero_count) / TIMING_ITERATIONS) / (cntfrq_mhz * 1000));
-    } else {
-        printf("  All samples were zero\n");
+    // Pin and lock first so clock calibration runs under the same isolation
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
     }
-}
-
-int main() {
-    char vendor[13] = {0};
-    uint64_t timing_results[NUM_SAMPLES];
-    uint64_t cntfrq;
-    asm volatile("mrs %0, cntfrq_el0" : "=r" (cntfrq));
-    double cntfrq_mhz = (double)cntfrq / 1000000;
 
-    printf("ARM64 CPU Detection Results:\n");
-    cpu_write_vendor(vendor);
-    printf("CPU Vendor: %s\n", vendor);
-    printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
-    printf("CPU Frequency: %.2f MHz\n", cntfrq_mhz);
+    print_system_info("CPU Detection Results:");
+    print_isolation(&iso_state);
+
+    int timing_series = 0;
+    if (trace_path != NULL) {
+        char config[256];
+        snprintf(config, sizeof(config),
+                 "samples=%d iterations=%d forks=%d serialized=%d cpu=%d fifo=%d mlock=%d warmup=%d",
+                 NUM_SAMPLES, TIMING_ITERATIONS, NUM_FORK_TESTS, serialized, iso_state.cpu,
+                 iso_state.fifo_priority, iso_state.memory_locked, iso_cfg.warmup_samples);
+        if (trace_open(&trace, trace_path, "aarm64_fork_cpu_test", config) < 0) {
+            perror(trace_path);
+            return 1;
+        }
+        tracing = &trace;
+        timing_series = trace_series(tracing, "Timing Statistics", TIMING_ITERATIONS);
+        for (int p = 0; p < FORK_NUM_PHASES; p++) {
+            phase_series[p] = trace_label(tracing, fork_phase_names[p]);
+            if (phase_series[p] < 0) {
+                timing_series = -1;
+            }
+        }
+        if (timing_series < 0) {
+            perror("trace labels");
+            return 1;
+        }
+    }
 
     printf("\nRunning CPU timing test...\n");
-    cpu_timing_test(timing_results, NUM_SAMPLES);
-    print_timing_stats(timing_results, NUM_SAMPLES, cntfrq_mhz);
+    isolation_warmup(&iso_cfg, serialized ? time_diff_serialized : time_diff, &warmup);
+    print_warmup("Timing", &warmup);
+    hist_init(&timing_hist);
+    cpu_timing_test(&timing_hist, NUM_SAMPLES, serialized, tracing, timing_series);
+    print_histogram(&timing_hist, "Timing Statistics", TIMING_ITERATIONS);
+    if (dump_buckets) {
+        print_histogram_buckets(&timing_hist);
+    }
 
     printf("\nRunning fork timing test...\n");
-    uint64_t total_fork_time = 0;
+    isolation_warmup(&iso_cfg, measure_fork_time, &warmup);
+    print_warmup("Fork", &warmup);
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        hist_init(&phase_hist[p]);
+    }
+    SampleRing *ring = sample_ring_create(NUM_FORK_TESTS * FORK_NUM_PHASES, FALSE);
+    SampleReporter reporter;
+    if (ring == NULL || sample_reporter_start(&reporter, &ring, 1, report_fork_sample, NULL, -1) < 0) {
+        perror("sample ring");
+        return 1;
+    }
     for (int i = 0; i < NUM_FORK_TESTS; i++) {
-        uint64_t fork_time = measure_fork_time();
-        total_fork_time += fork_time;
-        printf("Fork test %d: %.6f ms\n", i + 1, fork_time / (cntfrq_mhz * 1000));
+        uint64_t phases[FORK_NUM_PHASES];
+        if (measure_fork_phases(phases) < 0) {
+            break;
+        }
+        uint64_t now = get_system_time();
+        for (int p = 0; p < FORK_NUM_PHASES; p++) {
+            SampleRecord rec = {now, phases[p], i, p};
+            sample_ring_push(ring, &rec);
+        }
+    }
+    sample_reporter_stop(&reporter);
+    if (ring->dropped > 0) {
+        printf("Sample ring dropped %llu records\n", (unsigned long long)ring->dropped);
+    }
+    sample_ring_destroy(ring);
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        print_histogram(&phase_hist[p], fork_phase_names[p], 1);
+        if (dump_buckets) {
+            print_histogram_buckets(&phase_hist[p]);
+        }
+    }
+
+    if (tracing != NULL) {
+        if (trace_close(tracing) < 0) {
+            perror(trace_path);
+            return 1;
+        }
+        printf("\nTrace written to %s\n", trace_path);
     }
-    printf("Average fork time: %.6f ms\n", (total_fork_time / NUM_FORK_TESTS) / (cntfrq_mhz * 1000));
 
     return 0;
 }
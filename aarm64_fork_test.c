@@ -2,17 +2,13 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <sys/wait.h>
 
-#define TRUE 1
-#define FALSE 0
-#define NUM_FORK_TESTS 10
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+#include "sample_ring.h"
 
-static inline uint64_t get_system_time() {
-    uint64_t time;
-    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
-    return time;
-}
+#define NUM_FORK_TESTS 10
 
 static inline uint64_t time_diff() {
     uint64_t start, end;
@@ -21,73 +17,49 @@ static inline uint64_t time_diff() {
     return end - start;
 }
 
-static inline void get_cpu_info(char* vendor, char* brand) {
-    uint64_t midr;
-    asm volatile("mrs %0, midr_el1" : "=r" (midr));
-    
-    uint8_t implementer = (midr >> 24) & 0xFF;
-    uint8_t variant = (midr >> 20) & 0xF;
-    uint8_t architecture = (midr >> 16) & 0xF;
-    uint16_t part_num = (midr >> 4) & 0xFFF;
-    
-    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
-    strcpy(brand, "ARM Processor");
-}
-
-uint64_t cpu_timing_test() {
+void cpu_timing_test(Histogram *hist) {
     int i;
-    uint64_t avg = 0;
     for (i = 0; i < 10; i++) {
-        avg += time_diff();
+        hist_record(hist, time_diff());
         usleep(500000);  // Sleep for 500ms
     }
-    return avg / 10;
 }
 
-int cpu_hv() {
-    uint64_t id_aa64pfr0;
-    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
-    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
-}
+static Histogram phase_hist[FORK_NUM_PHASES];
 
-void cpu_write_vendor(char* vendor) {
-    char brand[49];
-    get_cpu_info(vendor, brand);
-}
-
-void cpu_write_brand(char* brand) {
-    char vendor[13];
-    get_cpu_info(vendor, brand);
-}
-
-uint64_t measure_fork_time() {
-    uint64_t start, end;
-    pid_t pid;
-
-    start = get_system_time();
-    
-    pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        _exit(0);
-    } else if (pid > 0) {
-        // Parent process
-        wait(NULL);
-        end = get_system_time();
-        return end - start;
-    } else {
-        // Fork failed
-        perror("fork");
-        return 0;
+// Runs on the reporter thread, so printing never lands between two forks
+static void report_fork_sample(const SampleRecord *rec, void *arg) {
+    hist_record(&phase_hist[rec->kind], rec->value);
+    if (rec->kind == FORK_PHASE_TOTAL) {
+        printf("Fork test %u: %llu cycles\n", rec->source + 1, (unsigned long long)rec->value);
     }
 }
 
-int main() {
+int main(int argc, char **argv) {
+    static Histogram timing_hist;
+    int dump_buckets = FALSE;
     char vendor[13] = {0};
     char brand[49] = {0};
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+    WarmupResult warmup;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        }
+    }
+
+    // Pin and lock first so clock calibration runs under the same isolation
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
 
-    printf("ARM64 CPU Detection Results:\n");
+    printf("CPU Detection Results:\n");
 
     cpu_write_vendor(vendor);
     printf("CPU Vendor: %s\n", vendor);
@@ -96,19 +68,54 @@ int main() {
     printf("CPU Brand: %s\n", brand);
 
     printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
+    printf("Clock: %s\n", bench_clock_name());
+    printf("Clock read overhead: median %llu ticks\n", (unsigned long long)bench_overhead[0].p50);
+    print_isolation(&iso_state);
 
     printf("Running timing test...\n");
-    uint64_t timing_result = cpu_timing_test();
-    printf("Average time difference: %llu cycles\n", timing_result);
+    isolation_warmup(&iso_cfg, time_diff, &warmup);
+    print_warmup("Timing", &warmup);
+    hist_init(&timing_hist);
+    cpu_timing_test(&timing_hist);
+    print_histogram(&timing_hist, "Time Difference", 1);
+    if (dump_buckets) {
+        print_histogram_buckets(&timing_hist);
+    }
 
     printf("\nMeasuring fork time...\n");
-    uint64_t total_fork_time = 0;
+    isolation_warmup(&iso_cfg, measure_fork_time, &warmup);
+    print_warmup("Fork", &warmup);
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        hist_init(&phase_hist[p]);
+    }
+    SampleRing *ring = sample_ring_create(NUM_FORK_TESTS * FORK_NUM_PHASES, FALSE);
+    SampleReporter reporter;
+    if (ring == NULL || sample_reporter_start(&reporter, &ring, 1, report_fork_sample, NULL, -1) < 0) {
+        perror("sample ring");
+        return 1;
+    }
     for (int i = 0; i < NUM_FORK_TESTS; i++) {
-        uint64_t fork_time = measure_fork_time();
-        total_fork_time += fork_time;
-        printf("Fork test %d: %llu cycles\n", i + 1, fork_time);
+        uint64_t phases[FORK_NUM_PHASES];
+        if (measure_fork_phases(phases) < 0) {
+            break;
+        }
+        uint64_t now = get_system_time();
+        for (int p = 0; p < FORK_NUM_PHASES; p++) {
+            SampleRecord rec = {now, phases[p], i, p};
+            sample_ring_push(ring, &rec);
+        }
+    }
+    sample_reporter_stop(&reporter);
+    if (ring->dropped > 0) {
+        printf("Sample ring dropped %llu records\n", (unsigned long long)ring->dropped);
+    }
+    sample_ring_destroy(ring);
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        print_histogram(&phase_hist[p], fork_phase_names[p], 1);
+        if (dump_buckets) {
+            print_histogram_buckets(&phase_hist[p]);
+        }
     }
-    printf("Average fork time: %llu cycles\n", total_fork_time / NUM_FORK_TESTS);
 
     return 0;
 }
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench_core.h"
+
+#if BENCH_CLOCK == BENCH_CLOCK_PERF
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#define CALIBRATION_NS 50000000ULL
+#define OVERHEAD_SAMPLES 10000
+
+int bench_perf_fd = -1;
+ClockOverhead bench_overhead[2];
+static uint64_t clock_freq;
+static uint64_t overhead_samples[OVERHEAD_SAMPLES];
+
+const char *fork_phase_names[FORK_NUM_PHASES] = {
+    "Fork: fork() return",
+    "Fork: child first instruction",
+    "Fork: child exit to parent wakeup",
+    "Fork: reap",
+    "Fork Timing",
+};
+
+// Timestamps written by the forked child: first instruction, then _exit()
+static volatile uint64_t *fork_stamps;
+
+#if BENCH_CLOCK == BENCH_CLOCK_RDTSC || BENCH_CLOCK == BENCH_CLOCK_RDTSCP || BENCH_CLOCK == BENCH_CLOCK_PERF
+static uint64_t monotonic_raw_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Counts clock ticks over a fixed stretch of CLOCK_MONOTONIC_RAW, for
+// backends whose frequency the hardware doesn't report
+static uint64_t calibrate_freq() {
+    uint64_t start_ns = monotonic_raw_ns();
+    uint64_t start = get_system_time();
+    uint64_t now_ns;
+
+    do {
+        now_ns = monotonic_raw_ns();
+    } while (now_ns - start_ns < CALIBRATION_NS);
+
+    uint64_t end = get_system_time();
+    return (uint64_t)((double)(end - start) * 1e9 / (double)(now_ns - start_ns));
+}
+#endif
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void calibrate_overhead(ClockOverhead *overhead, int serialized) {
+    for (int i = 0; i < OVERHEAD_SAMPLES; i++) {
+        uint64_t start, end;
+        if (serialized) {
+            start = get_system_time_start();
+            end = get_system_time_end();
+        } else {
+            start = get_system_time();
+            end = get_system_time();
+        }
+        overhead_samples[i] = end - start;
+    }
+
+    qsort(overhead_samples, OVERHEAD_SAMPLES, sizeof(uint64_t), compare_u64);
+    overhead->min = overhead_samples[0];
+    overhead->p50 = overhead_samples[OVERHEAD_SAMPLES / 2];
+    overhead->p99 = overhead_samples[OVERHEAD_SAMPLES * 99 / 100];
+    overhead->max = overhead_samples[OVERHEAD_SAMPLES - 1];
+}
+
+int bench_clock_init() {
+#if BENCH_CLOCK == BENCH_CLOCK_CNTVCT || BENCH_CLOCK == BENCH_CLOCK_CNTPCT
+    asm volatile("mrs %0, cntfrq_el0" : "=r" (clock_freq));
+#elif BENCH_CLOCK == BENCH_CLOCK_MONOTONIC_RAW
+    clock_freq = 1000000000ULL;
+#else
+#if BENCH_CLOCK == BENCH_CLOCK_PERF
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_hv = 1;
+
+    bench_perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (bench_perf_fd < 0) {
+        perror("perf_event_open(PERF_COUNT_HW_CPU_CYCLES)");
+        return -1;
+    }
+#endif
+    clock_freq = calibrate_freq();
+#endif
+
+    if (clock_freq == 0) {
+        fprintf(stderr, "Clock backend %s reports a zero frequency\n", bench_clock_name());
+        return -1;
+    }
+
+    calibrate_overhead(&bench_overhead[0], FALSE);
+    calibrate_overhead(&bench_overhead[1], TRUE);
+
+    return 0;
+}
+
+const char *bench_clock_name() {
+#if BENCH_CLOCK == BENCH_CLOCK_CNTVCT
+    return "cntvct_el0";
+#elif BENCH_CLOCK == BENCH_CLOCK_CNTPCT
+    return "cntpct_el0";
+#elif BENCH_CLOCK == BENCH_CLOCK_RDTSC
+    return "rdtsc";
+#elif BENCH_CLOCK == BENCH_CLOCK_RDTSCP
+    return "rdtscp";
+#elif BENCH_CLOCK == BENCH_CLOCK_MONOTONIC_RAW
+    return "CLOCK_MONOTONIC_RAW";
+#else
+    return "perf cycles";
+#endif
+}
+
+uint64_t bench_clock_freq() {
+    return clock_freq;
+}
+
+void bench_clock_set_freq(uint64_t freq) {
+    clock_freq = freq;
+}
+
+void get_cpu_info(char* vendor, char* brand) {
+#if defined(__aarch64__)
+    uint64_t midr;
+    asm volatile("mrs %0, midr_el1" : "=r" (midr));
+
+    uint8_t implementer = (midr >> 24) & 0xFF;
+    uint8_t variant = (midr >> 20) & 0xF;
+    uint8_t architecture = (midr >> 16) & 0xF;
+    uint16_t part_num = (midr >> 4) & 0xFFF;
+
+    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
+    strcpy(brand, "ARM Processor");
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int regs[12];
+
+    __cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+    memcpy(vendor, &regs[1], 4);
+    memcpy(vendor + 4, &regs[3], 4);
+    memcpy(vendor + 8, &regs[2], 4);
+    vendor[12] = '\0';
+
+    strcpy(brand, "x86 Processor");
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+        for (unsigned int leaf = 0; leaf < 3; leaf++) {
+            __cpuid(0x80000002 + leaf, regs[leaf * 4], regs[leaf * 4 + 1],
+                    regs[leaf * 4 + 2], regs[leaf * 4 + 3]);
+        }
+        memcpy(brand, regs, 48);
+        brand[48] = '\0';
+    }
+#else
+    strcpy(vendor, "unknown");
+    strcpy(brand, "unknown");
+#endif
+}
+
+void cpu_write_vendor(char* vendor) {
+    char brand[49];
+    get_cpu_info(vendor, brand);
+}
+
+void cpu_write_brand(char* brand) {
+    char vendor[13];
+    get_cpu_info(vendor, brand);
+}
+
+int cpu_hv() {
+#if defined(__aarch64__)
+    uint64_t id_aa64pfr0;
+    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
+    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    return (ecx >> 31) & 1 ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+// True if any of the files contains needle, ignoring case
+static int file_mentions(const char **paths, const char *needle) {
+    for (int i = 0; paths[i] != NULL; i++) {
+        char buf[256];
+        FILE *f = fopen(paths[i], "r");
+        if (f == NULL) {
+            continue;
+        }
+        size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        // Device tree strings are NUL-separated lists
+        for (size_t c = 0; c < len; c++) {
+            if (buf[c] == '\0') buf[c] = ' ';
+        }
+        buf[len] = '\0';
+        if (strcasestr(buf, needle) != NULL) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+const char *bench_environment() {
+    static const char *firmware[] = {
+        "/proc/device-tree/compatible",
+        "/proc/device-tree/model",
+        "/proc/device-tree/hypervisor/compatible",
+        "/sys/hypervisor/type",
+        "/sys/class/dmi/id/sys_vendor",
+        "/sys/class/dmi/id/product_name",
+        NULL,
+    };
+
+    if (file_mentions(firmware, "xvisor")) {
+        return "xvisor";
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (cpu_hv()) {
+        unsigned int eax, regs[3];
+        char signature[13];
+        __cpuid(0x40000000, eax, regs[0], regs[1], regs[2]);
+        memcpy(signature, regs, 12);
+        signature[12] = '\0';
+        return strcmp(signature, "KVMKVMKVM") == 0 ? "kvm" : "guest";
+    }
+#endif
+    if (file_mentions(firmware, "kvm")) {
+        return "kvm";
+    }
+    return cpu_hv() ? "guest" : "native";
+}
+
+uint32_t cpu_id() {
+#if defined(__aarch64__)
+    uint64_t midr;
+    asm volatile("mrs %0, midr_el1" : "=r" (midr));
+    return (uint32_t)midr;
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    __cpuid(1, eax, ebx, ecx, edx);
+    return eax;
+#else
+    return 0;
+#endif
+}
+
+void print_system_info(const char *title) {
+    char vendor[13] = {0};
+
+    printf("%s\n", title);
+    cpu_write_vendor(vendor);
+    printf("CPU Vendor: %s\n", vendor);
+    printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
+    printf("Clock: %s\n", bench_clock_name());
+    printf("CPU Frequency: %.2f MHz\n", (double)bench_clock_freq() / 1000000);
+    for (int serialized = 0; serialized < 2; serialized++) {
+        const ClockOverhead *o = &bench_overhead[serialized];
+        printf("Clock read overhead (%s): min %llu, median %llu, p99 %llu, max %llu ticks\n",
+               serialized ? "serialized" : "plain",
+               (unsigned long long)o->min, (unsigned long long)o->p50,
+               (unsigned long long)o->p99, (unsigned long long)o->max);
+    }
+}
+
+uint64_t measure_fork_time() {
+    uint64_t start, end;
+    pid_t pid;
+
+    start = get_system_time();
+    pid = fork();
+
+    if (pid == 0) {
+        // Child process
+        _exit(0);
+    } else if (pid > 0) {
+        // Parent process
+        wait(NULL);
+        end = get_system_time();
+        return bench_elapsed(start, end, FALSE);
+    } else {
+        // Fork failed
+        perror("fork");
+        return 0;
+    }
+}
+
+// Like bench_elapsed(), but stamps from two processes can be out of order
+// by a tick or two when the counter isn't perfectly synchronised
+static inline uint64_t phase_elapsed(uint64_t start, uint64_t end) {
+    return end > start ? bench_elapsed(start, end, FALSE) : 0;
+}
+
+int measure_fork_phases(uint64_t phases[FORK_NUM_PHASES]) {
+    uint64_t start, forked, exited, reaped;
+    siginfo_t info;
+    pid_t pid;
+
+    if (fork_stamps == NULL) {
+        void *page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            perror("mmap");
+            return -1;
+        }
+        fork_stamps = page;
+    }
+    fork_stamps[0] = 0;
+    fork_stamps[1] = 0;
+
+    start = get_system_time();
+    pid = fork();
+
+    if (pid == 0) {
+        // Child process
+        fork_stamps[0] = get_system_time();
+        fork_stamps[1] = get_system_time();
+        _exit(0);
+    } else if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    // Parent process
+    forked = get_system_time();
+    if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0) {
+        perror("waitid");
+        return -1;
+    }
+    exited = get_system_time();
+    if (waitpid(pid, NULL, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+    reaped = get_system_time();
+
+    phases[FORK_PHASE_CREATE] = phase_elapsed(start, forked);
+    phases[FORK_PHASE_FIRST_INSN] = phase_elapsed(start, fork_stamps[0]);
+    phases[FORK_PHASE_EXIT] = phase_elapsed(fork_stamps[1], exited);
+    phases[FORK_PHASE_REAP] = phase_elapsed(exited, reaped);
+    phases[FORK_PHASE_TOTAL] = phase_elapsed(start, reaped);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#ifndef BENCH_CORE_H
+#define BENCH_CORE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRUE 1
+#define FALSE 0
+
+// Clock backends for get_system_time(). One is picked at compile time with
+// -DBENCH_CLOCK=<name>; both the tool and bench_core.c must see the same
+// value. get_system_time() is inlined, so a sample never pays for dispatch.
+//
+//   BENCH_CLOCK_CNTVCT         AArch64 virtual counter (default on AArch64)
+//   BENCH_CLOCK_CNTPCT         AArch64 physical counter, needs EL0 access
+//   BENCH_CLOCK_RDTSC          x86 TSC (default on x86)
+//   BENCH_CLOCK_RDTSCP         x86 TSC, waits for earlier instructions
+//   BENCH_CLOCK_MONOTONIC_RAW  clock_gettime(), nanoseconds (default elsewhere)
+//   BENCH_CLOCK_PERF           perf_event CPU cycles, one read() per sample
+#define BENCH_CLOCK_CNTVCT 1
+#define BENCH_CLOCK_CNTPCT 2
+#define BENCH_CLOCK_RDTSC 3
+#define BENCH_CLOCK_RDTSCP 4
+#define BENCH_CLOCK_MONOTONIC_RAW 5
+#define BENCH_CLOCK_PERF 6
+
+#ifndef BENCH_CLOCK
+#if defined(__aarch64__)
+#define BENCH_CLOCK BENCH_CLOCK_CNTVCT
+#elif defined(__x86_64__) || defined(__i386__)
+#define BENCH_CLOCK BENCH_CLOCK_RDTSC
+#else
+#define BENCH_CLOCK BENCH_CLOCK_MONOTONIC_RAW
+#endif
+#endif
+
+#if (BENCH_CLOCK == BENCH_CLOCK_CNTVCT || BENCH_CLOCK == BENCH_CLOCK_CNTPCT) && !defined(__aarch64__)
+#error "cntvct_el0/cntpct_el0 clocks need an AArch64 target"
+#endif
+#if (BENCH_CLOCK == BENCH_CLOCK_RDTSC || BENCH_CLOCK == BENCH_CLOCK_RDTSCP) && \
+    !(defined(__x86_64__) || defined(__i386__))
+#error "rdtsc/rdtscp clocks need an x86 target"
+#endif
+
+#if BENCH_CLOCK == BENCH_CLOCK_RDTSC || BENCH_CLOCK == BENCH_CLOCK_RDTSCP
+#include <x86intrin.h>
+#endif
+
+// perf_event file descriptor used by BENCH_CLOCK_PERF
+extern int bench_perf_fd;
+
+static inline uint64_t get_system_time() {
+    uint64_t time;
+#if BENCH_CLOCK == BENCH_CLOCK_CNTVCT
+    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
+#elif BENCH_CLOCK == BENCH_CLOCK_CNTPCT
+    asm volatile("mrs %0, cntpct_el0" : "=r" (time));
+#elif BENCH_CLOCK == BENCH_CLOCK_RDTSC
+    time = __rdtsc();
+#elif BENCH_CLOCK == BENCH_CLOCK_RDTSCP
+    unsigned int aux;
+    time = __rdtscp(&aux);
+#elif BENCH_CLOCK == BENCH_CLOCK_MONOTONIC_RAW
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    time = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#elif BENCH_CLOCK == BENCH_CLOCK_PERF
+    if (read(bench_perf_fd, &time, sizeof(time)) != sizeof(time)) {
+        time = 0;
+    }
+#else
+#error "unknown BENCH_CLOCK"
+#endif
+    return time;
+}
+
+// Barrier that keeps the CPU from moving a counter read across the code
+// being timed: ISB on AArch64, LFENCE on x86. The vDSO and perf backends
+// only need the compiler barrier.
+static inline void bench_serialize() {
+#if (BENCH_CLOCK == BENCH_CLOCK_CNTVCT || BENCH_CLOCK == BENCH_CLOCK_CNTPCT)
+    asm volatile("isb" : : : "memory");
+#elif (BENCH_CLOCK == BENCH_CLOCK_RDTSC || BENCH_CLOCK == BENCH_CLOCK_RDTSCP)
+    asm volatile("lfence" : : : "memory");
+#else
+    asm volatile("" : : : "memory");
+#endif
+}
+
+// Serialized timestamps for short sections: nothing before the start read
+// or after the end read can leak into the interval.
+static inline uint64_t get_system_time_start() {
+    bench_serialize();
+    uint64_t time = get_system_time();
+    bench_serialize();
+    return time;
+}
+
+static inline uint64_t get_system_time_end() {
+#if BENCH_CLOCK == BENCH_CLOCK_RDTSC || BENCH_CLOCK == BENCH_CLOCK_RDTSCP
+    // rdtscp waits for earlier instructions; the fence keeps later ones out
+    unsigned int aux;
+    uint64_t time = __rdtscp(&aux);
+    bench_serialize();
+#else
+    bench_serialize();
+    uint64_t time = get_system_time();
+#endif
+    return time;
+}
+
+// Cost of reading the clock, measured from back-to-back reads when the
+// clock is initialised. Index 0 is plain reads, index 1 serialized reads.
+typedef struct {
+    uint64_t min;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+} ClockOverhead;
+
+extern ClockOverhead bench_overhead[2];
+
+// end - start with the median read cost taken out, floored at zero
+static inline uint64_t bench_elapsed(uint64_t start, uint64_t end, int serialized) {
+    uint64_t elapsed = end - start;
+    uint64_t overhead = bench_overhead[serialized ? 1 : 0].p50;
+    return elapsed > overhead ? elapsed - overhead : 0;
+}
+
+// Sets up the clock backend, measures its frequency and calibrates the read
+// overhead. Every tool calls it once before taking samples; returns -1 if
+// the backend is unavailable.
+int bench_clock_init();
+const char *bench_clock_name();
+
+// Clock ticks per second
+uint64_t bench_clock_freq();
+
+// Overrides the frequency used for tick conversions, for tools that report
+// ticks recorded on another machine (trace_analyze)
+void bench_clock_set_freq(uint64_t freq);
+
+static inline double ticks_to_ms(uint64_t ticks) {
+    return (double)ticks * 1000.0 / (double)bench_clock_freq();
+}
+
+void get_cpu_info(char* vendor, char* brand);
+void cpu_write_vendor(char* vendor);
+void cpu_write_brand(char* brand);
+int cpu_hv();
+
+// Best guess at where we run: "native", "kvm", "xvisor", or "guest" for a
+// hypervisor that can't be named. Xvisor is recognised only from firmware
+// strings that mention it, so tools let the user state it explicitly.
+const char *bench_environment();
+
+// Raw CPU identification register: MIDR_EL1 on AArch64, the CPUID leaf 1
+// signature on x86, 0 elsewhere
+uint32_t cpu_id();
+
+// Prints the clock backend, CPU vendor, hypervisor bit, clock frequency and
+// read overhead
+void print_system_info(const char *title);
+
+uint64_t measure_fork_time();
+
+// Fork cost split into phases. The child stamps the clock into a MAP_SHARED
+// page on its first instruction and just before _exit(); the parent stamps
+// fork() returning, waitid(WNOWAIT) returning once the child is a zombie,
+// and the final reap. Child stamps are compared with parent stamps, so the
+// clock must be the same on every CPU (not BENCH_CLOCK_PERF).
+enum {
+    FORK_PHASE_CREATE,       // fork() call until it returns in the parent
+    FORK_PHASE_FIRST_INSN,   // fork() call until the child runs
+    FORK_PHASE_EXIT,         // child's _exit() until the parent sees it
+    FORK_PHASE_REAP,         // releasing the zombie
+    FORK_PHASE_TOTAL,        // fork() call until the reap returns
+    FORK_NUM_PHASES
+};
+
+extern const char *fork_phase_names[FORK_NUM_PHASES];
+
+// Fills phases[] in clock ticks; returns -1 if fork or wait fails
+int measure_fork_phases(uint64_t phases[FORK_NUM_PHASES]);
+
+#endif
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+#include "sample_ring.h"
+
+#define DEFAULT_FORKS 1000
+#define STORM_RING_SIZE 16384
+#define BARRIER_SPINS 1000000     // spins before a waiting worker starts yielding
+
+// One slot per worker in the shared mapping. Fork latencies go through the
+// worker's own shared sample ring instead, to the parent's reporter thread.
+typedef struct {
+    int cpu;
+    uint64_t start;
+    uint64_t end;
+} StormWorker;
+
+typedef struct {
+    int ready;
+    int go;
+    StormWorker workers[];
+} Storm;
+
+static int allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    int n = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[n++] = cpu;
+        }
+    }
+    return n;
+}
+
+static void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        _exit(1);
+    }
+}
+
+// Pins itself, waits at the barrier with every other worker, then forks
+// as fast as it can
+static void run_worker(Storm *storm, int w, SampleRing *ring, int nforks) {
+    StormWorker *worker = &storm->workers[w];
+
+    pin_to_cpu(worker->cpu);
+
+    // Spin so every worker leaves the barrier within a few cycles. Under
+    // SCHED_FIFO a worker on the parent's CPU would starve it, so a long
+    // wait yields.
+    __atomic_add_fetch(&storm->ready, 1, __ATOMIC_ACQ_REL);
+    for (long spins = 0; !__atomic_load_n(&storm->go, __ATOMIC_ACQUIRE); spins++) {
+        if (spins > BARRIER_SPINS) {
+            sched_yield();
+        }
+    }
+
+    worker->start = get_system_time();
+    for (int i = 0; i < nforks; i++) {
+        SampleRecord rec = {0, measure_fork_time(), w, 0};
+        sample_ring_push(ring, &rec);
+    }
+    worker->end = get_system_time();
+    _exit(0);
+}
+
+static double ticks_to_us(double ticks) {
+    return ticks * 1000000.0 / (double)bench_clock_freq();
+}
+
+// Per-worker histograms, filled on the reporter thread
+static Histogram *worker_hists;
+
+static void report_fork(const SampleRecord *rec, void *arg) {
+    hist_record(&worker_hists[rec->source], rec->value);
+}
+
+// Starts nworkers pinned workers together and returns the aggregate rate
+// in forks per second
+static double run_storm(Storm *storm, const int *cpus, int nworkers, int nforks, Histogram *merged) {
+    SampleRing **rings = calloc(nworkers, sizeof(SampleRing *));
+    SampleReporter reporter;
+
+    storm->ready = 0;
+    storm->go = 0;
+    for (int w = 0; w < nworkers; w++) {
+        storm->workers[w].cpu = cpus[w];
+        hist_init(&worker_hists[w]);
+        rings[w] = sample_ring_create(STORM_RING_SIZE, TRUE);
+        if (rings[w] == NULL) {
+            perror("sample_ring_create");
+            exit(1);
+        }
+    }
+    if (sample_reporter_start(&reporter, rings, nworkers, report_fork, NULL, -1) < 0) {
+        exit(1);
+    }
+
+    for (int w = 0; w < nworkers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_worker(storm, w, rings[w], nforks);
+        } else if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+    }
+
+    while (__atomic_load_n(&storm->ready, __ATOMIC_ACQUIRE) < nworkers) {
+        sched_yield();
+    }
+    __atomic_store_n(&storm->go, 1, __ATOMIC_RELEASE);
+
+    for (int w = 0; w < nworkers; w++) {
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "fork storm worker failed\n");
+            exit(1);
+        }
+    }
+
+    sample_reporter_stop(&reporter);
+
+    uint64_t first_start = UINT64_MAX, last_end = 0;
+    hist_init(merged);
+    for (int w = 0; w < nworkers; w++) {
+        const StormWorker *worker = &storm->workers[w];
+        if (worker->start < first_start) first_start = worker->start;
+        if (worker->end > last_end) last_end = worker->end;
+        hist_merge(merged, &worker_hists[w]);
+        if (rings[w]->dropped > 0) {
+            printf("Worker %d dropped %llu samples\n", w, (unsigned long long)rings[w]->dropped);
+        }
+        sample_ring_destroy(rings[w]);
+    }
+    free(rings);
+
+    double seconds = (double)(last_end - first_start) / (double)bench_clock_freq();
+    return seconds > 0 ? (double)nworkers * nforks / seconds : 0.0;
+}
+
+static void print_worker(const char *label, int cpu, const Histogram *h) {
+    printf("    %-8s CPU %-4d p50 %10.2f us  p90 %10.2f us  p99 %10.2f us  max %10.2f us\n",
+           label, cpu, ticks_to_us(hist_percentile(h, 50.0)), ticks_to_us(hist_percentile(h, 90.0)),
+           ticks_to_us(hist_percentile(h, 99.0)), ticks_to_us(h->max));
+}
+
+int main(int argc, char **argv) {
+    static Histogram merged;
+    int nforks = DEFAULT_FORKS;
+    int max_workers = 0;
+    int dump_buckets = FALSE;
+    char label[24];
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+    WarmupResult warmup;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            nforks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            max_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        } else {
+            nforks = 0;
+            break;
+        }
+    }
+    if (nforks <= 0 || max_workers < 0) {
+        fprintf(stderr, "usage: %s [-n forks_per_worker] [-w max_workers] [-b]\n"
+                        "       [--cpu N] [--fifo PRIO] [--mlock] [--warmup N]\n", argv[0]);
+        return 1;
+    }
+
+    // Workers take their CPUs from the affinity before --cpu narrows it to
+    // the parent's, which then only runs the barrier and the reporter.
+    // They inherit SCHED_FIFO; memory locks aren't inherited across fork.
+    int *cpus = malloc(CPU_SETSIZE * sizeof(int));
+    int ncpus = allowed_cpus(cpus, CPU_SETSIZE);
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+    if (max_workers == 0 || max_workers > ncpus) {
+        max_workers = ncpus;
+    }
+
+    worker_hists = calloc(max_workers, sizeof(Histogram));
+    size_t storm_size = sizeof(Storm) + (size_t)max_workers * sizeof(StormWorker);
+    Storm *storm = mmap(NULL, storm_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (storm == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    print_system_info("Concurrent Fork Storm:\n");
+    print_isolation(&iso_state);
+    printf("Forks per worker: %d, CPUs available: %d\n", nforks, ncpus);
+    if (iso_cfg.warmup_samples > 0) {
+        isolation_warmup(&iso_cfg, measure_fork_time, &warmup);
+        print_warmup("Fork", &warmup);
+    }
+
+    // 1, 2, 4, ... workers, always finishing with every available CPU
+    double single_rate = 0.0;
+    for (int nworkers = 1;; nworkers = nworkers * 2 < max_workers ? nworkers * 2 : max_workers) {
+        double rate = run_storm(storm, cpus, nworkers, nforks, &merged);
+        if (nworkers == 1) {
+            single_rate = rate;
+        }
+
+        printf("\n%d worker%s: %.0f forks/s, scaling %.2f of linear\n", nworkers, nworkers == 1 ? "" : "s",
+               rate, single_rate > 0 ? rate / (single_rate * nworkers) : 0.0);
+        for (int w = 0; w < nworkers; w++) {
+            snprintf(label, sizeof(label), "worker %d", w);
+            print_worker(label, storm->workers[w].cpu, &worker_hists[w]);
+        }
+        print_histogram(&merged, "  All workers", 1);
+        if (dump_buckets) {
+            print_histogram_buckets(&merged);
+        }
+
+        if (nworkers == max_workers) {
+            break;
+        }
+    }
+
+    munmap(storm, storm_size);
+    free(worker_hists);
+    free(cpus);
+    return 0;
+}
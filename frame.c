@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "bench_core.h"
+#include "frame.h"
+
+#define FRAME_INITIAL_SIZE (16 * 1024)
+#define FRAME_INITIAL_LINE 256
+#define FRAME_INITIAL_LINES 64
+
+static int reserve(char **buf, size_t *size, size_t needed) {
+    if (needed <= *size) {
+        return 0;
+    }
+
+    size_t new_size = *size;
+    while (new_size < needed) {
+        new_size *= 2;
+    }
+    char *grown = realloc(*buf, new_size);
+    if (grown == NULL) {
+        return -1;
+    }
+    *buf = grown;
+    *size = new_size;
+    return 0;
+}
+
+static void append(FrameRenderer *fr, const char *s, size_t n) {
+    if (reserve(&fr->buf, &fr->size, fr->len + n) == 0) {
+        memcpy(fr->buf + fr->len, s, n);
+        fr->len += n;
+    }
+}
+
+static void line_append(FrameRenderer *fr, const char *s, size_t n) {
+    if (reserve(&fr->line, &fr->line_size, fr->line_len + n) == 0) {
+        memcpy(fr->line + fr->line_len, s, n);
+        fr->line_len += n;
+    }
+}
+
+static void line_pad(FrameRenderer *fr, int count) {
+    static const char spaces[] = "                                ";
+    while (count > 0) {
+        int n = count < (int)sizeof(spaces) - 1 ? count : (int)sizeof(spaces) - 1;
+        line_append(fr, spaces, n);
+        count -= n;
+    }
+}
+
+// Digits of value into the end of a 20-byte buffer; returns the first one
+static char *format_u64(char *end, uint64_t value) {
+    char *p = end;
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    return p;
+}
+
+static uint64_t hash_line(const char *s, size_t n) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int frame_init(FrameRenderer *fr, int fd) {
+    memset(fr, 0, sizeof(*fr));
+    fr->fd = fd;
+    fr->tty = isatty(fd);
+    fr->size = FRAME_INITIAL_SIZE;
+    fr->line_size = FRAME_INITIAL_LINE;
+    fr->max_lines = FRAME_INITIAL_LINES;
+    fr->buf = malloc(fr->size);
+    fr->line = malloc(fr->line_size);
+    fr->hashes = calloc(fr->max_lines, sizeof(uint64_t));
+    fr->keys = calloc(fr->max_lines, sizeof(uint64_t));
+    fr->shown = calloc(fr->max_lines, sizeof(uint64_t));
+    fr->shown_keys = calloc(fr->max_lines, sizeof(uint64_t));
+    fr->redraw = TRUE;
+    return fr->buf && fr->line && fr->hashes && fr->keys && fr->shown && fr->shown_keys ? 0 : -1;
+}
+
+void frame_free(FrameRenderer *fr) {
+    free(fr->buf);
+    free(fr->line);
+    free(fr->hashes);
+    free(fr->keys);
+    free(fr->shown);
+    free(fr->shown_keys);
+}
+
+void frame_invalidate(FrameRenderer *fr) {
+    fr->redraw = TRUE;
+}
+
+void frame_begin(FrameRenderer *fr) {
+    fr->len = 0;
+    fr->line_len = 0;
+    fr->nlines = 0;
+    fr->match = 0;
+    if (fr->redraw && fr->tty) {
+        append(fr, "\033[2J", 4);
+    }
+}
+
+void frame_put_str(FrameRenderer *fr, const char *s, int width) {
+    size_t n = strlen(s);
+    line_append(fr, s, n);
+    line_pad(fr, width - (int)n);
+}
+
+void frame_put_u64(FrameRenderer *fr, uint64_t value, int width) {
+    char digits[20];
+    char *p = format_u64(digits + sizeof(digits), value);
+    int n = (int)(digits + sizeof(digits) - p);
+
+    line_pad(fr, width - n);
+    line_append(fr, p, n);
+}
+
+void frame_put_fixed(FrameRenderer *fr, double value, int decimals, int width) {
+    static const uint64_t scales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    char digits[48];
+    char *end = digits + sizeof(digits);
+
+    if (decimals > 6) decimals = 6;
+    if (value < 0) value = 0;
+    uint64_t scaled = (uint64_t)(value * scales[decimals] + 0.5);
+
+    // Fraction digits with leading zeros, then the point, then the integer part
+    char *p = end;
+    uint64_t frac = scaled % scales[decimals];
+    for (int i = 0; i < decimals; i++) {
+        *--p = '0' + frac % 10;
+        frac /= 10;
+    }
+    if (decimals > 0) {
+        *--p = '.';
+    }
+    p = format_u64(p, scaled / scales[decimals]);
+
+    int n = (int)(end - p);
+    line_pad(fr, width - n);
+    line_append(fr, p, n);
+}
+
+static int grow_lines(FrameRenderer *fr) {
+    uint64_t **tables[] = { &fr->hashes, &fr->keys, &fr->shown, &fr->shown_keys };
+    int max_lines = fr->max_lines * 2;
+
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        uint64_t *grown = realloc(*tables[t], max_lines * sizeof(uint64_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        *tables[t] = grown;
+    }
+    fr->max_lines = max_lines;
+    return 0;
+}
+
+// Whether the previous frame showed this key with this text. Keys keep
+// their order between frames, so the search resumes after the last match
+// and a whole frame costs one pass over the previous one.
+static int shown_unchanged(FrameRenderer *fr, int row, uint64_t key, uint64_t hash) {
+    if (fr->tty) {
+        // Cursor addressing: a line that moved has to be drawn again
+        return row < fr->nshown && fr->shown_keys[row] == key && fr->shown[row] == hash;
+    }
+    for (int i = fr->match; i < fr->nshown; i++) {
+        if (fr->shown_keys[i] == key) {
+            fr->match = i + 1;
+            return fr->shown[i] == hash;
+        }
+    }
+    return FALSE;
+}
+
+void frame_end_line(FrameRenderer *fr) {
+    frame_end_keyed_line(fr, fr->nlines);
+}
+
+void frame_end_keyed_line(FrameRenderer *fr, uint64_t key) {
+    if (fr->nlines == fr->max_lines && grow_lines(fr) < 0) {
+        fr->line_len = 0;
+        return;
+    }
+
+    int row = fr->nlines++;
+    uint64_t hash = hash_line(fr->line, fr->line_len);
+    fr->hashes[row] = hash;
+    fr->keys[row] = key;
+
+    if (fr->redraw || !shown_unchanged(fr, row, key, hash)) {
+        if (fr->tty) {
+            // Cursor to the row, the line, then clear whatever was left of
+            // a longer one
+            char move[32];
+            int n = snprintf(move, sizeof(move), "\033[%d;1H", row + 1);
+            append(fr, move, n);
+            append(fr, fr->line, fr->line_len);
+            append(fr, "\033[K", 3);
+        } else {
+            append(fr, fr->line, fr->line_len);
+            append(fr, "\n", 1);
+        }
+    }
+    fr->line_len = 0;
+}
+
+// The console is behind if it can't take more output right now, or if a
+// terminal still has more queued than this frame would add
+static int console_ready(FrameRenderer *fr) {
+    struct pollfd pfd = { .fd = fr->fd, .events = POLLOUT };
+    if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLOUT)) {
+        return FALSE;
+    }
+
+    int queued;
+    if (fr->tty && ioctl(fr->fd, TIOCOUTQ, &queued) == 0 && (size_t)queued > fr->len) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int frame_flush(FrameRenderer *fr) {
+    // Blank the rows a longer previous frame left behind
+    if (fr->tty && fr->nlines < fr->nshown) {
+        char move[32];
+        int n = snprintf(move, sizeof(move), "\033[%d;1H\033[J", fr->nlines + 1);
+        append(fr, move, n);
+    }
+
+    fr->frames++;
+    if (fr->len > 0) {
+        if (!console_ready(fr)) {
+            fr->dropped++;
+            return 0;
+        }
+
+        size_t off = 0;
+        while (off < fr->len) {
+            ssize_t n = write(fr->fd, fr->buf + off, fr->len - off);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            off += n;
+        }
+    }
+
+    memcpy(fr->shown, fr->hashes, fr->nlines * sizeof(uint64_t));
+    memcpy(fr->shown_keys, fr->keys, fr->nlines * sizeof(uint64_t));
+    fr->nshown = fr->nlines;
+    fr->redraw = FALSE;
+    return 1;
+}
+
+void frame_interrupts(FrameRenderer *fr, const InterruptSnapshot *curr, const InterruptSnapshot *prev,
+                      double elapsed_ms, int have_cpu_delta) {
+    char cpu_digits[16] = {0};
+
+    // The interval only changes when ticks are missed, so it gets its own
+    // line instead of making every IRQ line differ
+    frame_put_str(fr, "Elapsed Time: ", 0);
+    frame_put_fixed(fr, elapsed_ms, 3, 0);
+    frame_put_str(fr, " ms", 0);
+    frame_end_line(fr);
+
+    for (int i = 0; i < curr->nirqs; i++) {
+        int prev_index = snapshot_find_row(prev, &curr->info[i], i);
+        if (prev_index == -1) {
+            continue;
+        }
+
+        unsigned long long count_diff = curr->info[i].count - prev->info[prev_index].count;
+        if (count_diff == 0) {
+            continue;
+        }
+
+        frame_put_str(fr, "Interrupt: IRQ ", 0);
+        frame_put_str(fr, curr->info[i].label, 0);
+        frame_put_str(fr, ", Name: ", 0);
+        frame_put_str(fr, curr->info[i].name, 20);
+        frame_put_str(fr, ", Count: ", 0);
+        frame_put_u64(fr, count_diff, 0);
+        frame_put_str(fr, ", Avg Time Between: ", 0);
+        frame_put_fixed(fr, elapsed_ms / count_diff, 3, 0);
+        frame_put_str(fr, " ms", 0);
+        frame_end_keyed_line(fr, curr->info[i].key);
+
+        if (have_cpu_delta && curr->ncpus >= 2) {
+            frame_put_str(fr, "    Per-CPU:", 0);
+            for (int column = 0; column < curr->ncpus; column++) {
+                uint32_t count = snapshot_cpu_delta(curr, column, i);
+                if (count > 0) {
+                    char *p = format_u64(cpu_digits + sizeof(cpu_digits) - 1, snapshot_cpu_id(curr, column));
+                    frame_put_str(fr, " CPU", 0);
+                    frame_put_str(fr, p, 0);
+                    frame_put_str(fr, " ", 0);
+                    frame_put_u64(fr, count, 0);
+                }
+            }
+            frame_end_keyed_line(fr, ~curr->info[i].key);
+        }
+    }
+}
+
+// Softirqs shown as columns, so the header never changes between frames
+static const char *frame_softirqs[] = { "TIMER", "NET_TX", "NET_RX", "BLOCK", "SCHED", "HRTIMER", "RCU" };
+#define FRAME_NUM_SOFTIRQS (int)(sizeof(frame_softirqs) / sizeof(frame_softirqs[0]))
+
+static void frame_cpu_rates(FrameRenderer *fr, const char *label, const CpuRates *rates, const int *columns) {
+    double busy = 100.0 - rates->time_pct[CPU_TIME_IDLE] - rates->time_pct[CPU_TIME_IOWAIT];
+
+    frame_put_str(fr, label, 6);
+    if (rates->irqs_per_s >= 0) {
+        frame_put_fixed(fr, rates->irqs_per_s, 1, 11);
+    } else {
+        frame_put_str(fr, "          -", 0);
+    }
+    frame_put_fixed(fr, rates->time_pct[CPU_TIME_IRQ], 1, 9);
+    frame_put_fixed(fr, rates->time_pct[CPU_TIME_SOFTIRQ], 1, 9);
+    frame_put_fixed(fr, rates->time_pct[CPU_TIME_STEAL], 1, 9);
+    frame_put_fixed(fr, busy > 0 ? busy : 0, 1, 9);
+    for (int s = 0; s < FRAME_NUM_SOFTIRQS; s++) {
+        frame_put_fixed(fr, columns[s] >= 0 ? rates->softirqs_per_s[columns[s]] : 0, 1, 10);
+    }
+    frame_end_line(fr);
+}
+
+void frame_cpu_activity(FrameRenderer *fr, const SystemSnapshot *curr, const SystemSnapshot *prev) {
+    int columns[FRAME_NUM_SOFTIRQS];
+    CpuRates rates;
+    char label[16] = "CPU";
+
+    for (int s = 0; s < FRAME_NUM_SOFTIRQS; s++) {
+        columns[s] = -1;
+        for (int i = 0; i < curr->nsoftirqs; i++) {
+            if (strcmp(curr->softirq_names[i], frame_softirqs[s]) == 0) {
+                columns[s] = i;
+            }
+        }
+    }
+
+    frame_put_str(fr, "CPU", 6);
+    frame_put_str(fr, "      IRQ/s hardirq% softirq%   steal%    busy%", 0);
+    for (int s = 0; s < FRAME_NUM_SOFTIRQS; s++) {
+        frame_put_str(fr, " ", 10 - (int)strlen(frame_softirqs[s]) - 2);
+        frame_put_str(fr, frame_softirqs[s], 0);
+        frame_put_str(fr, "/s", 0);
+    }
+    frame_end_line(fr);
+
+    for (int cpu = 0; cpu < curr->ncpus; cpu++) {
+        if (system_cpu_rates(curr, prev, cpu, &rates) == 0) {
+            char *p = format_u64(label + sizeof(label) - 1, cpu);
+            memmove(label + 3, p, label + sizeof(label) - p);
+            frame_cpu_rates(fr, label, &rates, columns);
+        }
+    }
+    if (curr->ncpus > 1 && system_cpu_rates(curr, prev, -1, &rates) == 0) {
+        frame_cpu_rates(fr, "All", &rates, columns);
+    }
+}
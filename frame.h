@@ -0,0 +1,74 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "proc_interrupts.h"
+#include "proc_stat.h"
+
+// Frame renderer for the interrupt monitors. A frame is built line by line
+// in a reusable buffer with hand-rolled number formatting, and only lines
+// that differ from what is already on the console are kept: on a terminal
+// each changed line is redrawn in place with a cursor move, otherwise the
+// changed lines are appended as plain text. The frame then goes out in a
+// single write(). If the console still has the previous frame queued, the
+// new one is dropped rather than letting output fall further behind.
+//
+// Lines are identified by a key: their row for fixed lines, or something
+// like the IRQ label's hash for lines that come and go. A keyed line is
+// unchanged if the previous frame had the same key with the same text, so
+// redirected output stays quiet when other rows appear; a terminal still
+// repaints it if it moved to another row.
+typedef struct {
+    int fd;
+    int tty;
+    char *buf;            // the frame being built
+    size_t len;
+    size_t size;
+    char *line;           // the line being built
+    size_t line_len;
+    size_t line_size;
+    uint64_t *hashes;     // hash of each line in the frame being built
+    uint64_t *keys;       // key of each line in the frame being built
+    uint64_t *shown;      // hash of each line on the console
+    uint64_t *shown_keys;
+    int match;            // where the next key lookup in shown_keys starts
+    int nlines;
+    int nshown;
+    int max_lines;
+    int redraw;           // repaint everything on the next frame
+    uint64_t frames;
+    uint64_t dropped;
+} FrameRenderer;
+
+int frame_init(FrameRenderer *fr, int fd);
+void frame_free(FrameRenderer *fr);
+
+// Forces a full repaint on the next flush, after other output
+void frame_invalidate(FrameRenderer *fr);
+
+void frame_begin(FrameRenderer *fr);
+
+// Line building. Widths pad with spaces: strings on the right, numbers on
+// the left. frame_put_fixed prints value with the given decimals.
+void frame_put_str(FrameRenderer *fr, const char *s, int width);
+void frame_put_u64(FrameRenderer *fr, uint64_t value, int width);
+void frame_put_fixed(FrameRenderer *fr, double value, int decimals, int width);
+void frame_end_line(FrameRenderer *fr);
+void frame_end_keyed_line(FrameRenderer *fr, uint64_t key);
+
+// Writes the changed lines in one write(). Returns 1 if the frame was
+// written, 0 if it was dropped because the console is behind, -1 on error.
+int frame_flush(FrameRenderer *fr);
+
+// The interval, then one line per IRQ that fired during it, keyed by the
+// IRQ's label, with its per-CPU split on a second line when there is one
+void frame_interrupts(FrameRenderer *fr, const InterruptSnapshot *curr, const InterruptSnapshot *prev,
+                      double elapsed_ms, int have_cpu_delta);
+
+// A header and one line per online CPU, then the whole system: interrupt
+// rate, hardirq, softirq, steal and busy time, and the main softirq rates
+void frame_cpu_activity(FrameRenderer *fr, const SystemSnapshot *curr, const SystemSnapshot *prev);
+
+#endif
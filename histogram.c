@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+
+void hist_init(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_merge(Histogram *dst, const Histogram *src) {
+    if (src->total == 0) {
+        return;
+    }
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    dst->sum_sq += src->sum_sq;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_bucket_low(int index) {
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = index / HIST_HALF_BUCKETS - 1;
+    uint64_t sub = index % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS;
+    return sub << shift;
+}
+
+uint64_t hist_bucket_high(int index) {
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = index / HIST_HALF_BUCKETS - 1;
+    return hist_bucket_low(index) + ((1ULL << shift) - 1);
+}
+
+uint64_t hist_percentile(const Histogram *h, double p) {
+    if (h->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(p / 100.0 * h->total);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t low = hist_bucket_low(i);
+            uint64_t value = low + (hist_bucket_high(i) - low) / 2;
+            if (value < h->min) value = h->min;
+            if (value > h->max) value = h->max;
+            return value;
+        }
+    }
+
+    return h->max;
+}
+
+double hist_mean(const Histogram *h) {
+    return h->total > 0 ? h->sum / h->total : 0.0;
+}
+
+double hist_stddev(const Histogram *h) {
+    if (h->total < 2) {
+        return 0.0;
+    }
+
+    double mean = hist_mean(h);
+    double variance = h->sum_sq / h->total - mean * mean;
+    return variance > 0 ? sqrt(variance) : 0.0;
+}
+
+static inline double ticks_to_us(double ticks) {
+    return ticks * 1000000.0 / (double)bench_clock_freq();
+}
+
+static void print_value(const char *label, uint64_t ticks) {
+    printf("  %-8s %12llu ticks %14.3f us\n", label, (unsigned long long)ticks, ticks_to_us(ticks));
+}
+
+void print_histogram(const Histogram *h, const char *title, int iterations) {
+    printf("%s:\n", title);
+    printf("  Samples: %llu\n", (unsigned long long)h->total);
+    if (h->total == 0) {
+        printf("  No samples recorded\n");
+        return;
+    }
+
+    print_value("Minimum", h->min);
+    print_value("p50", hist_percentile(h, 50.0));
+    print_value("p90", hist_percentile(h, 90.0));
+    print_value("p99", hist_percentile(h, 99.0));
+    print_value("p99.9", hist_percentile(h, 99.9));
+    print_value("p99.99", hist_percentile(h, 99.99));
+    print_value("Maximum", h->max);
+    printf("  %-8s %12.2f ticks %14.3f us\n", "Mean", hist_mean(h), ticks_to_us(hist_mean(h)));
+    printf("  %-8s %12.2f ticks %14.3f us\n", "Stddev", hist_stddev(h), ticks_to_us(hist_stddev(h)));
+    if (iterations > 1) {
+        printf("  Mean per iteration: %.6f us\n", ticks_to_us(hist_mean(h)) / iterations);
+    }
+}
+
+void print_histogram_buckets(const Histogram *h) {
+    uint64_t seen = 0;
+
+    printf("  %20s %20s %12s %9s\n", "From (ticks)", "To (ticks)", "Count", "Cumul %");
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->counts[i] == 0) {
+            continue;
+        }
+        seen += h->counts[i];
+        printf("  %20llu %20llu %12llu %8.4f%%\n",
+               (unsigned long long)hist_bucket_low(i), (unsigned long long)hist_bucket_high(i),
+               (unsigned long long)h->counts[i], 100.0 * seen / h->total);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear (HDR-style) latency histogram. Values below HIST_SUB_BUCKETS
+// get one bucket each; above that every power of two is split into
+// HIST_HALF_BUCKETS equal buckets, so any value is kept to within 1/64
+// (about 1.6%) using a fixed 30 KiB of counts for the whole uint64_t range.
+//
+// A Histogram holds no pointers, so it can live in MAP_SHARED memory or be
+// copied between processes and combined with hist_merge().
+#define HIST_SUB_BUCKET_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_HALF_BUCKETS (HIST_SUB_BUCKETS / 2)
+#define HIST_BUCKETS ((64 - HIST_SUB_BUCKET_BITS + 2) * HIST_HALF_BUCKETS)
+
+typedef struct {
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    double sum_sq;
+    uint64_t counts[HIST_BUCKETS];
+} Histogram;
+
+static inline int hist_index(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HIST_SUB_BUCKET_BITS - 1);
+    return (shift + 1) * HIST_HALF_BUCKETS + (int)((value >> shift) - HIST_HALF_BUCKETS);
+}
+
+static inline void hist_record(Histogram *h, uint64_t value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+    h->sum += (double)value;
+    h->sum_sq += (double)value * (double)value;
+}
+
+void hist_init(Histogram *h);
+void hist_merge(Histogram *dst, const Histogram *src);
+
+// Smallest and largest value that fall into bucket index
+uint64_t hist_bucket_low(int index);
+uint64_t hist_bucket_high(int index);
+
+// Value at percentile p (0-100), reported as the middle of its bucket and
+// clamped to the recorded min/max
+uint64_t hist_percentile(const Histogram *h, double p);
+double hist_mean(const Histogram *h);
+double hist_stddev(const Histogram *h);
+
+// Sample count, min, p50/p90/p99/p99.9/p99.99, max, mean and stddev in clock
+// ticks and microseconds. With iterations > 1 each sample covers that many
+// loop iterations and a per-iteration mean is added.
+void print_histogram(const Histogram *h, const char *title, int iterations);
+
+// Every non-empty bucket with its range, count and cumulative percentage
+void print_histogram_buckets(const Histogram *h);
+
+#endif
@@ -3,227 +3,170 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <time.h>
 #include <fcntl.h>
 #include <ctype.h>
-#include <sys/select.h>
 
-#define TRUE 1
-#define FALSE 0
-#define MAX_INTERRUPTS 256
-
-typedef struct {
-    int irq;
-    char name[64];
-    unsigned long long count;
-} InterruptInfo;
-
-volatile sig_atomic_t running = 1;
-
-static inline uint64_t get_system_time() {
-    uint64_t time;
-    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
-    return time;
-}
-
-static inline void get_cpu_info(char* vendor, char* brand) {
-    uint64_t midr;
-    asm volatile("mrs %0, midr_el1" : "=r" (midr));
-    
-    uint8_t implementer = (midr >> 24) & 0xFF;
-    uint8_t variant = (midr >> 20) & 0xF;
-    uint8_t architecture = (midr >> 16) & 0xF;
-    uint16_t part_num = (midr >> 4) & 0xFFF;
-    
-    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
-    strcpy(brand, "ARM Processor");
-}
-
-int cpu_hv() {
-    uint64_t id_aa64pfr0;
-    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
-    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
-}
-
-void cpu_write_vendor(char* vendor) {
-    char brand[49];
-    get_cpu_info(vendor, brand);
-}
-
-void read_interrupts(InterruptInfo *interrupts, int *count) {
-    FILE *fp = fopen("/proc/interrupts", "r");
-    if (fp == NULL) {
-        perror("Failed to open /proc/interrupts");
-        exit(1);
+#include "bench_core.h"
+#include "frame.h"
+#include "load_gen.h"
+#include "monitor_loop.h"
+#include "proc_interrupts.h"
+#include "proc_stat.h"
+
+// Random interrupt bursts: BURST_OPS operations of one mode, BURST_RATE a
+// second, on a generator thread so the refresh keeps running
+#define BURST_OPS 5
+#define BURST_RATE 10.0
+
+int main(int argc, char **argv) {
+    SystemSnapshot snapshots[2];
+    SystemSnapshot *prev = &snapshots[0], *curr = &snapshots[1];
+    SystemFiles files;
+    MonitorLoop loop;
+    MonitorEvent event;
+    FrameRenderer frame;
+    uint64_t period_ns = MONITOR_DEFAULT_PERIOD_NS;
+    LoadGen burst;
+    LoadConfig load;
+    int modes[LOAD_NUM_MODES];
+    int nmodes = LOAD_NUM_MODES;
+    int burst_running = FALSE;
+
+    load_config_init(&load, LOAD_UDP);
+    load.rate = BURST_RATE;
+    load.count = BURST_OPS;
+    for (int mode = 0; mode < LOAD_NUM_MODES; mode++) {
+        modes[mode] = mode;
     }
 
-    char line[256];
-    *count = 0;
-
-    // Skip the header line
-    fgets(line, sizeof(line), fp);
-
-    while (fgets(line, sizeof(line), fp) && *count < MAX_INTERRUPTS) {
-        InterruptInfo *info = &interrupts[*count];
-        char *token = strtok(line, " ");
-        if (token == NULL) continue;
-
-        // Remove colon from IRQ number
-        char *colon = strchr(token, ':');
-        if (colon) *colon = '\0';
-
-        info->irq = atoi(token);
-
-        // Skip CPU-specific counts
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") != strlen(token)) {
-                break;
-            }
-        }
-
-        if (token == NULL) continue;
-
-        strncpy(info->name, token, sizeof(info->name) - 1);
-        info->name[sizeof(info->name) - 1] = '\0';
-
-        info->count = 0;
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") == strlen(token)) {
-                info->count += strtoull(token, NULL, 10);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            period_ns = monitor_period_arg(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            nmodes = load_modes_parse(argv[++i], modes, LOAD_NUM_MODES);
+            if (nmodes <= 0) {
+                fprintf(stderr, "unknown load mode in %s\n", argv[i]);
+                return 1;
             }
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            load.cpu = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-p period_us] [-g modes] [-c cpu]\n", argv[0]);
+            return 1;
         }
-
-        (*count)++;
-    }
-
-    fclose(fp);
-}
-
-void signal_handler(int signum) {
-    running = 0;
-}
-
-void clear_screen() {
-    printf("\033[2J");    // ANSI escape code to clear screen
-    printf("\033[H");     // Move cursor to home position
-}
-
-void generate_random_interrupt() {
-    int choice = rand() % 4;  // 0-3 for four types of interrupts
-
-    switch(choice) {
-        case 0:  // Disk I/O
-            {
-                FILE *file = fopen("/tmp/test_file", "w");
-                if (file != NULL) {
-                    fprintf(file, "Test data for interrupt generation");
-                    fclose(file);
-                    remove("/tmp/test_file");
-                }
-            }
-            break;
-        case 1:  // Network
-            system("ping -c 1 localhost &>/dev/null");
-            break;
-        case 2:  // Timer
-            usleep(1000);
-            break;
-        case 3:  // CPU-intensive task
-            {
-                volatile int i;
-                for(i = 0; i < 1000000; i++) {}  // Busy-wait loop
-            }
-            break;
     }
-}
 
-int main() {
-    char vendor[13] = {0};
-    InterruptInfo interrupts_prev[MAX_INTERRUPTS], interrupts_curr[MAX_INTERRUPTS];
-    int count_prev, count_curr;
-
-    signal(SIGINT, signal_handler);
     srand(time(NULL));  // Initialize random number generator
 
-    printf("ARM64 CPU and Interrupt Monitor:\n\n");
-
-    cpu_write_vendor(vendor);
-    printf("CPU Vendor: %s\n", vendor);
-    printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
-
-    // Get CPU frequency
-    uint64_t cntfrq;
-    asm volatile("mrs %0, cntfrq_el0" : "=r" (cntfrq));
-    double cntfrq_mhz = (double)cntfrq / 1000000;
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
 
-    printf("CPU Frequency: %.2f MHz\n", cntfrq_mhz);
-    printf("\nMonitoring interrupts. Press 'i' followed by Enter to generate random interrupts.\n");
+    print_system_info("CPU and Interrupt Monitor:\n");
+    printf("\nMonitoring interrupts every %.3f ms. Press 'i' followed by Enter to generate random interrupts.\n",
+           period_ns / 1000000.0);
     printf("Press 'r' to reset baseline, 'q' to quit.\n\n");
 
-    read_interrupts(interrupts_prev, &count_prev);
-    uint64_t last_check_time = get_system_time();
-
-    char input[3];
-    while (running) {
-        fd_set fds;
-        struct timeval tv = {0, 0};
-        FD_ZERO(&fds);
-        FD_SET(STDIN_FILENO, &fds);
-
-        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0) {
-            if (fgets(input, sizeof(input), stdin)) {
-                if (input[0] == 'i' && (input[1] == '\n' || input[1] == '\r')) {
-                    printf("Generating random interrupts...\n");
-                    for (int i = 0; i < 5; i++) {  // Generate 5 random interrupts
-                        generate_random_interrupt();
-                        usleep(100000);  // 100ms delay between interrupts
-                    }
-                } else if (input[0] == 'r') {
-                    clear_screen();
-                    printf("Resetting interrupt baseline...\n");
-                    read_interrupts(interrupts_prev, &count_prev);
-                    last_check_time = get_system_time();
-                    continue;
-                } else if (input[0] == 'q') {
-                    running = 0;
-                    break;
+    if (system_files_open(&files) < 0) {
+        perror("Failed to open /proc/interrupts, /proc/softirqs and /proc/stat");
+        return 1;
+    }
+    if (system_snapshot_init(prev) < 0 || system_snapshot_init(curr) < 0) {
+        perror("Failed to allocate snapshots");
+        return 1;
+    }
+
+    if (monitor_loop_init(&loop, period_ns) < 0) {
+        perror("Failed to set up the monitor loop");
+        return 1;
+    }
+    if (frame_init(&frame, STDOUT_FILENO) < 0) {
+        perror("Failed to allocate the frame buffer");
+        return 1;
+    }
+    // Frames bypass stdio, so anything printed so far goes out first
+    fflush(stdout);
+
+    read_system(&files, prev);
+
+    int reset_baseline = FALSE;
+    while (monitor_loop_wait(&loop, &event) == 0 && event.type != MONITOR_QUIT) {
+        if (event.type == MONITOR_KEY) {
+            if (event.key == 'i' && !burst_running) {
+                load.mode = modes[rand() % nmodes];
+                if (load_gen_start(&burst, &load) == 0) {
+                    printf("Generating random interrupts (%s)...\n", load_mode_names[load.mode]);
+                    burst_running = TRUE;
                 }
+                fflush(stdout);
+                frame_invalidate(&frame);
+            } else if (event.key == 'r') {
+                printf("Resetting interrupt baseline...\n");
+                fflush(stdout);
+                frame_invalidate(&frame);
+                // Taken on the next tick, so every interval stays whole periods
+                reset_baseline = TRUE;
+            } else if (event.key == 'q') {
+                break;
             }
+            continue;
         }
 
-        uint64_t current_time = get_system_time();
-        read_interrupts(interrupts_curr, &count_curr);
-
-        double elapsed_ms = (double)(current_time - last_check_time) / cntfrq_mhz / 1000.0;
+        if (burst_running && __atomic_load_n(&burst.done, __ATOMIC_ACQUIRE)) {
+            load_gen_stop(&burst);
+            print_load_gen(&burst);
+            fflush(stdout);
+            frame_invalidate(&frame);
+            burst_running = FALSE;
+        }
 
-        for (int i = 0; i < count_curr; i++) {
-            int prev_index = -1;
-            for (int j = 0; j < count_prev; j++) {
-                if (interrupts_curr[i].irq == interrupts_prev[j].irq) {
-                    prev_index = j;
-                    break;
-                }
-            }
+        if (reset_baseline) {
+            read_system(&files, prev);
+            reset_baseline = FALSE;
+            continue;
+        }
+        read_system(&files, curr);
 
-            if (prev_index != -1) {
-                unsigned long long count_diff = interrupts_curr[i].count - interrupts_prev[prev_index].count;
-                if (count_diff > 0) {
-                    double avg_time_between_ms = elapsed_ms / count_diff;
+        double elapsed_ms = event.interval_ns / 1000000.0;
 
-                    printf("Interrupt: IRQ %d, Name: %-20s, Count: %-5llu, Elapsed Time: %.3f ms, Avg Time Between: %.3f ms\n",
-                           interrupts_curr[i].irq, interrupts_curr[i].name, count_diff, elapsed_ms, avg_time_between_ms);
-                }
-            }
+        // Per-CPU deltas are only meaningful while the row set is unchanged
+        int have_cpu_delta = snapshot_same_layout(&curr->irqs, &prev->irqs);
+        if (have_cpu_delta) {
+            snapshot_delta(&curr->irqs, &prev->irqs);
         }
 
-        memcpy(interrupts_prev, interrupts_curr, sizeof(InterruptInfo) * count_curr);
-        count_prev = count_curr;
-        last_check_time = current_time;
-
-        usleep(100000);  // Sleep for 100ms to reduce CPU usage
+        frame_begin(&frame);
+        frame_put_str(&frame, "Dropped frames: ", 0);
+        frame_put_u64(&frame, frame.dropped, 0);
+        frame_put_str(&frame, ", missed ticks: ", 0);
+        frame_put_u64(&frame, loop.missed, 0);
+        frame_end_line(&frame);
+        frame_cpu_activity(&frame, curr, prev);
+        frame_interrupts(&frame, &curr->irqs, &prev->irqs, elapsed_ms, have_cpu_delta);
+        frame_flush(&frame);
+
+        SystemSnapshot *tmp = prev;
+        prev = curr;
+        curr = tmp;
     }
 
+    if (burst_running) {
+        load_gen_stop(&burst);
+        print_load_gen(&burst);
+    }
+    if (loop.missed > 0) {
+        printf("\n%llu refresh ticks were missed while processing ran late.\n", (unsigned long long)loop.missed);
+    }
+    if (frame.dropped > 0) {
+        printf("\n%llu of %llu frames were dropped while the console was behind.\n",
+               (unsigned long long)frame.dropped, (unsigned long long)frame.frames);
+    }
+    monitor_loop_close(&loop);
+    frame_free(&frame);
+    system_snapshot_free(prev);
+    system_snapshot_free(curr);
+    system_files_close(&files);
     printf("\nInterrupt monitoring stopped.\n");
 
     return 0;
@@ -3,184 +3,388 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <time.h>
 #include <fcntl.h>
-
-#define TRUE 1
-#define FALSE 0
-#define MAX_INTERRUPTS 256
+#include <math.h>
+
+#include "bench_core.h"
+#include "frame.h"
+#include "histogram.h"
+#include "load_gen.h"
+#include "monitor_loop.h"
+#include "proc_interrupts.h"
+#include "proc_stat.h"
+#include "sample_ring.h"
+#include "stats.h"
+
+// Attribution mode (-a): measures an idle baseline, then runs each load
+// mode alone with its operations logged, and charges every interrupt
+// source's rise over the baseline to the operations of the same windows
+#define DEFAULT_ATTR_WINDOW_MS 200
+#define DEFAULT_ATTR_WINDOWS 25
+#define DEFAULT_ATTR_RATE 200.0
+#define ATTR_LOG_SIZE 65536
 
 typedef struct {
-    int irq;
-    char name[64];
-    unsigned long long count;
-} InterruptInfo;
-
-volatile sig_atomic_t running = 1;
-
-static inline uint64_t get_system_time() {
-    uint64_t time;
-    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
-    return time;
+    ProcFile *pf;
+    InterruptSnapshot *prev;
+    InterruptSnapshot *curr;
+    InterruptSnapshot *ref;   // row layout every window must match
+    uint64_t deadline_ns;
+    uint64_t window_ns;
+    uint64_t last;            // clock ticks at the previous snapshot
+    double *delta;            // per-row interrupts in the last window
+    uint64_t discarded;       // windows dropped for a layout change
+} AttributionRun;
+
+// Generator operations, assigned to windows by their start time
+typedef struct {
+    uint64_t window_end;
+    uint64_t ops;             // in the window that just closed
+    uint64_t next_ops;        // started after it closed
+    uint64_t failed;
+    Histogram cost;
+} OpTally;
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-static inline void get_cpu_info(char* vendor, char* brand) {
-    uint64_t midr;
-    asm volatile("mrs %0, midr_el1" : "=r" (midr));
-    
-    uint8_t implementer = (midr >> 24) & 0xFF;
-    uint8_t variant = (midr >> 20) & 0xF;
-    uint8_t architecture = (midr >> 16) & 0xF;
-    uint16_t part_num = (midr >> 4) & 0xFFF;
-    
-    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
-    strcpy(brand, "ARM Processor");
-}
+static void tally_op(const SampleRecord *rec, void *arg) {
+    OpTally *tally = arg;
 
-int cpu_hv() {
-    uint64_t id_aa64pfr0;
-    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
-    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
+    if (rec->kind != LOAD_OP_DONE) {
+        tally->failed++;
+        return;
+    }
+    hist_record(&tally->cost, rec->value);
+    if (rec->timestamp < tally->window_end) {
+        tally->ops++;
+    } else {
+        tally->next_ops++;
+    }
 }
 
-void cpu_write_vendor(char* vendor) {
-    char brand[49];
-    get_cpu_info(vendor, brand);
+static void ignore_op(const SampleRecord *rec, void *arg) {
+    (void)rec;
+    (void)arg;
 }
 
-void read_interrupts(InterruptInfo *interrupts, int *count) {
-    FILE *fp = fopen("/proc/interrupts", "r");
-    if (fp == NULL) {
-        perror("Failed to open /proc/interrupts");
-        exit(1);
+// Sleeps to the end of the next window and snapshots. Returns the window
+// length in seconds with run->delta filled in, or 0 if the row layout
+// changed and the window can't be used.
+static double attr_window(AttributionRun *run) {
+    run->deadline_ns += run->window_ns;
+    struct timespec ts = { (time_t)(run->deadline_ns / 1000000000ULL), (long)(run->deadline_ns % 1000000000ULL) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
     }
 
-    char line[256];
-    *count = 0;
+    read_interrupts(run->pf, run->curr);
+    uint64_t now = get_system_time();
+    double seconds = (double)(now - run->last) / (double)bench_clock_freq();
+    run->last = now;
 
-    // Skip the header line
-    fgets(line, sizeof(line), fp);
-
-    while (fgets(line, sizeof(line), fp) && *count < MAX_INTERRUPTS) {
-        InterruptInfo *info = &interrupts[*count];
-        char *token = strtok(line, " ");
-        if (token == NULL) continue;
-
-        // Remove colon from IRQ number
-        char *colon = strchr(token, ':');
-        if (colon) *colon = '\0';
+    int usable = snapshot_same_layout(run->curr, run->ref) && snapshot_same_layout(run->prev, run->ref);
+    if (usable) {
+        for (int i = 0; i < run->ref->nirqs; i++) {
+            run->delta[i] = (double)(run->curr->info[i].count - run->prev->info[i].count);
+        }
+    } else {
+        run->discarded++;
+    }
 
-        info->irq = atoi(token);
+    InterruptSnapshot *tmp = run->prev;
+    run->prev = run->curr;
+    run->curr = tmp;
+    return usable ? seconds : 0;
+}
 
-        // Skip CPU-specific counts
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") != strlen(token)) {
-                break;
-            }
+static void print_attribution(const AttributionRun *run, const RunningStat *base, const RunningStat *per_op,
+                              const RunningStat *seconds_per_op, int nrows) {
+    int shown = 0;
+
+    printf("  %-16s %-20s %14s %14s %12s\n", "IRQ", "Name", "Per op", "95% CI +/-", "Idle/s");
+    // The last row is the sum over every source
+    for (int i = 0; i < nrows; i++) {
+        int all = i == nrows - 1;
+        double estimate = per_op[i].mean - base[i].mean * seconds_per_op->mean;
+        double se_load = stat_stderr(&per_op[i]);
+        double se_base = stat_stderr(&base[i]) * seconds_per_op->mean;
+        uint64_t n = per_op[i].n < base[i].n ? per_op[i].n : base[i].n;
+        double half = t_critical95(n > 0 ? n - 1 : 0) * sqrt(se_load * se_load + se_base * se_base);
+
+        // Only sources that rose clearly above their idle rate
+        if (!all && estimate - half <= 0) {
+            continue;
+        }
+        if (all && shown == 0) {
+            printf("  no source rose above its idle rate\n");
         }
+        printf("  %-16s %-20.20s %14.4f %14.4f %12.1f\n", all ? "All" : run->ref->info[i].label,
+               all ? "" : run->ref->info[i].name, estimate, half, base[i].mean);
+        shown++;
+    }
+}
 
-        if (token == NULL) continue;
+static int run_attribution(ProcFile *pf, InterruptSnapshot *prev, InterruptSnapshot *curr, InterruptSnapshot *ref,
+                           const int *modes, int nmodes, const LoadConfig *load, int window_ms, int windows) {
+    AttributionRun run = { pf, prev, curr, ref, 0, window_ms * 1000000ULL, 0, NULL, 0 };
+    static OpTally tally;
+    LoadGen gen;
+
+    read_interrupts(pf, ref);
+    read_interrupts(pf, run.prev);
+    run.last = get_system_time();
+    run.deadline_ns = monotonic_ns();
+
+    // One extra row at the end for the sum over all sources
+    int nrows = ref->nirqs + 1;
+    run.delta = calloc(nrows, sizeof(double));
+    RunningStat *base = calloc(nrows, sizeof(RunningStat));
+    RunningStat *per_op = calloc(nrows, sizeof(RunningStat));
+    SampleRing *log = sample_ring_create(ATTR_LOG_SIZE, FALSE);
+    if (run.delta == NULL || base == NULL || per_op == NULL || log == NULL) {
+        perror("Failed to allocate attribution state");
+        return 1;
+    }
 
-        strncpy(info->name, token, sizeof(info->name) - 1);
-        info->name[sizeof(info->name) - 1] = '\0';
+    printf("\nAttribution: %d windows of %d ms per phase, idle baseline first\n", windows, window_ms);
+    fflush(stdout);
 
-        info->count = 0;
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") == strlen(token)) {
-                info->count += strtoull(token, NULL, 10);
-            }
+    for (int w = 0; w < windows; w++) {
+        double seconds = attr_window(&run);
+        if (seconds == 0) {
+            continue;
         }
-
-        (*count)++;
+        double sum = 0;
+        for (int i = 0; i < nrows - 1; i++) {
+            stat_add(&base[i], run.delta[i] / seconds);
+            sum += run.delta[i];
+        }
+        stat_add(&base[nrows - 1], sum / seconds);
     }
+    printf("\nIdle baseline: %.1f interrupts/s over %llu windows\n", base[nrows - 1].mean,
+           (unsigned long long)base[nrows - 1].n);
+
+    for (int m = 0; m < nmodes; m++) {
+        LoadConfig cfg = *load;
+        RunningStat seconds_per_op;
+
+        cfg.mode = modes[m];
+        cfg.log = log;
+        memset(&tally, 0, sizeof(tally));
+        hist_init(&tally.cost);
+        stat_init(&seconds_per_op);
+        for (int i = 0; i < nrows; i++) {
+            stat_init(&per_op[i]);
+        }
 
-    fclose(fp);
-}
+        if (load_gen_start(&gen, &cfg) < 0) {
+            continue;
+        }
+        // The first window only lets the generator reach its rate
+        for (int w = -1; w < windows; w++) {
+            double seconds = attr_window(&run);
+            tally.window_end = run.last;
+            sample_ring_drain(log, tally_op, &tally);
+            uint64_t ops = tally.ops;
+            tally.ops = tally.next_ops;
+            tally.next_ops = 0;
+            if (w < 0 || seconds == 0 || ops == 0) {
+                continue;
+            }
 
-void signal_handler(int signum) {
-    running = 0;
-}
+            double sum = 0;
+            for (int i = 0; i < nrows - 1; i++) {
+                stat_add(&per_op[i], run.delta[i] / ops);
+                sum += run.delta[i];
+            }
+            stat_add(&per_op[nrows - 1], sum / ops);
+            stat_add(&seconds_per_op, seconds / ops);
+        }
+        load_gen_stop(&gen);
+        sample_ring_drain(log, ignore_op, NULL);
+
+        printf("\nMode %s: target %.1f ops/s, achieved %.1f ops/s, %llu windows", load_mode_names[cfg.mode],
+               cfg.rate, load_gen_rate(&gen), (unsigned long long)seconds_per_op.n);
+        if (tally.failed > 0 || log->dropped > 0) {
+            printf(", %llu failed and %llu unlogged ops", (unsigned long long)tally.failed,
+                   (unsigned long long)log->dropped);
+        }
+        printf("\n");
+        if (seconds_per_op.n < 2) {
+            printf("  too few windows with operations to attribute\n");
+            continue;
+        }
 
-void generate_interrupts() {
-    // Generate disk I/O interrupt
-    FILE *file = fopen("/tmp/test_file", "w");
-    if (file != NULL) {
-        fprintf(file, "Test data for interrupt generation");
-        fclose(file);
-        remove("/tmp/test_file");
+        double mean = hist_mean(&tally.cost), half = 0;
+        if (tally.cost.total > 1) {
+            half = t_critical95(tally.cost.total - 1) * hist_stddev(&tally.cost) / sqrt((double)tally.cost.total);
+        }
+        printf("  Cost per op: %.3f us +/- %.3f (95%% CI), p50 %.3f us, p99 %.3f us\n",
+               ticks_to_ms((uint64_t)mean) * 1000.0, ticks_to_ms((uint64_t)half) * 1000.0,
+               ticks_to_ms(hist_percentile(&tally.cost, 50.0)) * 1000.0,
+               ticks_to_ms(hist_percentile(&tally.cost, 99.0)) * 1000.0);
+        print_attribution(&run, base, per_op, &seconds_per_op, nrows);
+        log->dropped = 0;
+    }
+    if (run.discarded > 0) {
+        printf("\n%llu windows were discarded because /proc/interrupts changed layout\n",
+               (unsigned long long)run.discarded);
     }
 
-    // Generate network-related interrupt (this might not work in all environments)
-    system("ping -c 1 localhost &>/dev/null");
-
-    // Generate timer interrupt
-    usleep(1000);
+    sample_ring_destroy(log);
+    free(per_op);
+    free(base);
+    free(run.delta);
+    return 0;
 }
 
-int main() {
-    char vendor[13] = {0};
-    InterruptInfo interrupts_prev[MAX_INTERRUPTS], interrupts_curr[MAX_INTERRUPTS];
-    int count_prev, count_curr;
-
-    signal(SIGINT, signal_handler);
-
-    printf("ARM64 CPU and Interrupt Monitor:\n\n");
+int main(int argc, char **argv) {
+    SystemSnapshot snapshots[2];
+    SystemSnapshot *prev = &snapshots[0], *curr = &snapshots[1];
+    SystemFiles files;
+    MonitorLoop loop;
+    MonitorEvent event;
+    FrameRenderer frame;
+    uint64_t period_ns = MONITOR_DEFAULT_PERIOD_NS;
+    // Background load, by default one disk, network and timer operation a second
+    LoadGen gens[LOAD_NUM_MODES];
+    LoadConfig load;
+    int modes[LOAD_NUM_MODES] = { LOAD_DISK, LOAD_UDP, LOAD_TIMER };
+    int nmodes = 3, ngens;
+    int attribution = FALSE, rate_set = FALSE;
+    int window_ms = DEFAULT_ATTR_WINDOW_MS, windows = DEFAULT_ATTR_WINDOWS;
+
+    load_config_init(&load, LOAD_UDP);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            period_ns = monitor_period_arg(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            nmodes = load_modes_parse(argv[++i], modes, LOAD_NUM_MODES);
+            if (nmodes < 0) {
+                fprintf(stderr, "unknown load mode in %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            load.rate = atof(argv[++i]);
+            rate_set = TRUE;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            load.cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            attribution = TRUE;
+        } else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+            window_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            windows = atoi(argv[++i]);
+        } else {
+            window_ms = 0;
+            break;
+        }
+    }
+    if (window_ms <= 0 || windows < 2) {
+        fprintf(stderr, "usage: %s [-p period_us] [-g modes|none] [-r ops_per_s] [-c cpu]\n"
+                        "       %s -a [-W window_ms] [-n windows] [-g modes] [-r ops_per_s] [-c cpu]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
 
-    cpu_write_vendor(vendor);
-    printf("CPU Vendor: %s\n", vendor);
-    printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
 
-    // Get CPU frequency
-    uint64_t cntfrq;
-    asm volatile("mrs %0, cntfrq_el0" : "=r" (cntfrq));
-    double cntfrq_mhz = (double)cntfrq / 1000000;
+    print_system_info("CPU and Interrupt Monitor:\n");
+    if (attribution) {
+        if (!rate_set) {
+            load.rate = DEFAULT_ATTR_RATE;
+        }
+        InterruptSnapshot attr_snapshots[3];
+        ProcFile proc_interrupts;
+        if (proc_file_open(&proc_interrupts, "/proc/interrupts", PROC_FILE_BUF_SIZE) < 0 ||
+            snapshot_init(&attr_snapshots[0]) < 0 || snapshot_init(&attr_snapshots[1]) < 0 ||
+            snapshot_init(&attr_snapshots[2]) < 0) {
+            perror("Failed to set up /proc/interrupts snapshots");
+            return 1;
+        }
+        int ret = run_attribution(&proc_interrupts, &attr_snapshots[0], &attr_snapshots[1],
+                                  &attr_snapshots[2], modes, nmodes, &load, window_ms, windows);
+        for (int i = 0; i < 3; i++) {
+            snapshot_free(&attr_snapshots[i]);
+        }
+        proc_file_close(&proc_interrupts);
+        return ret;
+    }
+    printf("\nMonitoring interrupts every %.3f ms. Press Ctrl+C to stop.\n\n", period_ns / 1000000.0);
 
-    printf("CPU Frequency: %.2f MHz\n", cntfrq_mhz);
-    printf("\nMonitoring interrupts. Press Ctrl+C to stop.\n\n");
+    if (system_files_open(&files) < 0) {
+        perror("Failed to open /proc/interrupts, /proc/softirqs and /proc/stat");
+        return 1;
+    }
+    if (system_snapshot_init(prev) < 0 || system_snapshot_init(curr) < 0) {
+        perror("Failed to allocate snapshots");
+        return 1;
+    }
 
-    read_interrupts(interrupts_prev, &count_prev);
-    uint64_t last_check_time = get_system_time();
+    if (monitor_loop_init(&loop, period_ns) < 0) {
+        perror("Failed to set up the monitor loop");
+        return 1;
+    }
+    if (frame_init(&frame, STDOUT_FILENO) < 0) {
+        perror("Failed to allocate the frame buffer");
+        return 1;
+    }
+    // Frames bypass stdio, so anything printed so far goes out first
+    fflush(stdout);
 
-    int iteration = 0;
-    while (running) {
-        usleep(100000);  // Sleep for 100ms
+    read_system(&files, prev);
+    ngens = load_gens_start(gens, modes, nmodes, &load);
 
-        // Generate interrupts every 10 iterations (approximately every 1 second)
-        if (++iteration % 10 == 0) {
-            generate_interrupts();
+    while (monitor_loop_wait(&loop, &event) == 0 && event.type != MONITOR_QUIT) {
+        if (event.type != MONITOR_TICK) {
+            continue;
         }
 
-        uint64_t current_time = get_system_time();
-        read_interrupts(interrupts_curr, &count_curr);
+        read_system(&files, curr);
 
-        double elapsed_ms = (double)(current_time - last_check_time) / cntfrq_mhz / 1000.0;
+        double elapsed_ms = event.interval_ns / 1000000.0;
 
-        for (int i = 0; i < count_curr; i++) {
-            int prev_index = -1;
-            for (int j = 0; j < count_prev; j++) {
-                if (interrupts_curr[i].irq == interrupts_prev[j].irq) {
-                    prev_index = j;
-                    break;
-                }
-            }
-
-            if (prev_index != -1) {
-                unsigned long long count_diff = interrupts_curr[i].count - interrupts_prev[prev_index].count;
-                if (count_diff > 0) {
-                    double avg_time_between_ms = elapsed_ms / count_diff;
-
-                    printf("Interrupt: IRQ %d, Name: %-20s, Count: %-5llu, Elapsed Time: %.3f ms, Avg Time Between: %.3f ms\n",
-                           interrupts_curr[i].irq, interrupts_curr[i].name, count_diff, elapsed_ms, avg_time_between_ms);
-                }
-            }
+        // Per-CPU deltas are only meaningful while the row set is unchanged
+        int have_cpu_delta = snapshot_same_layout(&curr->irqs, &prev->irqs);
+        if (have_cpu_delta) {
+            snapshot_delta(&curr->irqs, &prev->irqs);
         }
 
-        memcpy(interrupts_prev, interrupts_curr, sizeof(InterruptInfo) * count_curr);
-        count_prev = count_curr;
-        last_check_time = current_time;
+        frame_begin(&frame);
+        frame_put_str(&frame, "Dropped frames: ", 0);
+        frame_put_u64(&frame, frame.dropped, 0);
+        frame_put_str(&frame, ", missed ticks: ", 0);
+        frame_put_u64(&frame, loop.missed, 0);
+        frame_end_line(&frame);
+        frame_cpu_activity(&frame, curr, prev);
+        frame_interrupts(&frame, &curr->irqs, &prev->irqs, elapsed_ms, have_cpu_delta);
+        frame_flush(&frame);
+
+        SystemSnapshot *tmp = prev;
+        prev = curr;
+        curr = tmp;
     }
 
+    load_gens_stop(gens, ngens);
+    if (loop.missed > 0) {
+        printf("\n%llu refresh ticks were missed while processing ran late.\n", (unsigned long long)loop.missed);
+    }
+    if (frame.dropped > 0) {
+        printf("\n%llu of %llu frames were dropped while the console was behind.\n",
+               (unsigned long long)frame.dropped, (unsigned long long)frame.frames);
+    }
+    monitor_loop_close(&loop);
+    frame_free(&frame);
+    system_snapshot_free(prev);
+    system_snapshot_free(curr);
+    system_files_close(&files);
     printf("\nInterrupt monitoring stopped.\n");
 
     return 0;
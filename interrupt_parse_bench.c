@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "proc_interrupts.h"
+
+#define DEFAULT_ITERATIONS 20000
+#define LEGACY_MAX_INTERRUPTS 256
+#define MAX_SYNTHETIC 8
+
+static const char *default_fixtures[] = {
+    "fixtures/interrupts_x86_1cpu.txt",
+    "fixtures/interrupts_xvisor_guest_4cpu.txt",
+    "fixtures/interrupts_arm64_gicv3_8cpu.txt",
+    "fixtures/interrupts_xvisor_guest_cpu1_offline.txt",
+};
+
+// The row layout the monitors used before growable tables
+typedef struct {
+    int irq;
+    char name[64];
+    unsigned long long count;
+} LegacyInterruptInfo;
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The fopen/fgets/strtok parser the monitors used before, kept as the baseline
+static void legacy_read_interrupts(const char *path, LegacyInterruptInfo *interrupts, int *count) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    char line[256];
+    *count = 0;
+
+    // Skip the header line
+    fgets(line, sizeof(line), fp);
+
+    while (fgets(line, sizeof(line), fp) && *count < LEGACY_MAX_INTERRUPTS) {
+        LegacyInterruptInfo *info = &interrupts[*count];
+        char *token = strtok(line, " ");
+        if (token == NULL) continue;
+
+        char *colon = strchr(token, ':');
+        if (colon) *colon = '\0';
+
+        info->irq = atoi(token);
+
+        while ((token = strtok(NULL, " ")) != NULL) {
+            if (strspn(token, "0123456789") != strlen(token)) {
+                break;
+            }
+        }
+
+        if (token == NULL) continue;
+
+        strncpy(info->name, token, sizeof(info->name) - 1);
+        info->name[sizeof(info->name) - 1] = '\0';
+
+        info->count = 0;
+        while ((token = strtok(NULL, " ")) != NULL) {
+            if (strspn(token, "0123456789") == strlen(token)) {
+                info->count += strtoull(token, NULL, 10);
+            }
+        }
+
+        (*count)++;
+    }
+
+    fclose(fp);
+}
+
+static int count_lines(const char *buf, size_t len) {
+    int lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == '\n') lines++;
+    }
+    // The header line is not a row
+    return lines > 0 ? lines - 1 : 0;
+}
+
+static void print_result(const char *label, uint64_t elapsed_ns, int iterations, int lines) {
+    double per_snapshot = (double)elapsed_ns / iterations;
+    printf("  %-22s %10.1f ns/snapshot %8.2f ns/line\n",
+           label, per_snapshot, lines > 0 ? per_snapshot / lines : 0.0);
+}
+
+// Synthetic tables: every count, label and name is a function of its row and
+// CPU, so a parsed snapshot can be checked cell by cell
+static inline uint32_t synthetic_count(int row, int cpu) {
+    return (uint32_t)((row * 2654435761ULL + cpu * 40503ULL) % 4000000000ULL);
+}
+
+static void synthetic_name(char *name, size_t size, int row) {
+    // Every seventh name is longer than the old 64-byte name field
+    if (row % 7 == 0) {
+        snprintf(name, size, "synthetic-msi-vector-%d-with-a-device-name-long-enough-to-overflow-old-fields", row);
+    } else {
+        snprintf(name, size, "chip%d", row % 13);
+    }
+}
+
+static int write_synthetic(const char *path, int ncpus, int nrows) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char name[128];
+    fprintf(fp, "      ");
+    for (int cpu = 0; cpu < ncpus; cpu++) {
+        fprintf(fp, "     CPU%-3d", cpu);
+    }
+    fprintf(fp, "\n");
+
+    for (int row = 0; row < nrows; row++) {
+        fprintf(fp, "%5d:", row);
+        for (int cpu = 0; cpu < ncpus; cpu++) {
+            fprintf(fp, " %10u", synthetic_count(row, cpu));
+        }
+        synthetic_name(name, sizeof(name), row);
+        fprintf(fp, "  %s %d-edge      dev%d\n", name, row, row);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int verify_synthetic(const InterruptSnapshot *snap, int ncpus, int nrows) {
+    char name[128];
+    char label[16];
+
+    if (snap->nirqs != nrows || snap->ncpus != ncpus) {
+        printf("  MISMATCH: parsed %d rows x %d CPUs, expected %d x %d\n",
+               snap->nirqs, snap->ncpus, nrows, ncpus);
+        return -1;
+    }
+
+    for (int row = 0; row < nrows; row++) {
+        const InterruptInfo *info = &snap->info[row];
+        unsigned long long total = 0;
+
+        for (int cpu = 0; cpu < ncpus; cpu++) {
+            uint32_t expected = synthetic_count(row, cpu);
+            uint32_t parsed = snap->counts[(size_t)cpu * snap->max_irqs + row];
+            if (parsed != expected) {
+                printf("  MISMATCH: row %d CPU %d count %u, expected %u\n", row, cpu, parsed, expected);
+                return -1;
+            }
+            total += expected;
+        }
+
+        snprintf(label, sizeof(label), "%d", row);
+        synthetic_name(name, sizeof(name), row);
+        if (info->irq != row || info->count != total ||
+            strcmp(info->label, label) != 0 || strcmp(info->name, name) != 0) {
+            printf("  MISMATCH: row %d parsed as IRQ %d (%s) %s, total %llu\n",
+                   row, info->irq, info->label, info->name, info->count);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Checks the column to CPU map against the header, read here with sscanf,
+// and that a CPU with no column (offline) is not found
+static int verify_cpu_columns(const char *buf, size_t len, const InterruptSnapshot *snap) {
+    const char *p = buf, *end = memchr(buf, '\n', len);
+    int column = 0, next_cpu = 0, cpu, n;
+
+    if (end == NULL) {
+        end = buf + len;
+    }
+    while (p < end && sscanf(p, " CPU%d%n", &cpu, &n) == 1) {
+        for (; next_cpu < cpu; next_cpu++) {
+            if (snapshot_cpu_column(snap, next_cpu) != -1) {
+                printf("  MISMATCH: offline CPU %d has column %d\n", next_cpu, snapshot_cpu_column(snap, next_cpu));
+                return -1;
+            }
+        }
+        if (column >= snap->ncpus || snapshot_cpu_id(snap, column) != cpu ||
+            snapshot_cpu_column(snap, cpu) != column) {
+            printf("  MISMATCH: header column %d is CPU%d, parsed as CPU%d\n", column, cpu,
+                   column < snap->ncpus ? snapshot_cpu_id(snap, column) : -1);
+            return -1;
+        }
+        column++;
+        next_cpu = cpu + 1;
+        p += n;
+    }
+    if (column != snap->ncpus) {
+        printf("  MISMATCH: header has %d CPU columns, parsed %d\n", column, snap->ncpus);
+        return -1;
+    }
+    if (next_cpu != column) {
+        printf("  CPU columns:");
+        for (column = 0; column < snap->ncpus; column++) {
+            printf(" %d", snapshot_cpu_id(snap, column));
+        }
+        printf(" (offline CPUs skipped)\n");
+    }
+    return 0;
+}
+
+static int bench_file(const char *path, int iterations, int synthetic_cpus, int synthetic_rows) {
+    static LegacyInterruptInfo legacy[LEGACY_MAX_INTERRUPTS];
+    InterruptSnapshot snapshots[2];
+    ProcFile pf;
+    int count = 0;
+    int status = 0;
+
+    if (proc_file_open(&pf, path, PROC_FILE_BUF_SIZE) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if (snapshot_init(&snapshots[0]) < 0 || snapshot_init(&snapshots[1]) < 0) {
+        perror("snapshot_init");
+        exit(1);
+    }
+
+    ssize_t len = proc_file_read(&pf);
+    if (len < 0) {
+        perror(path);
+        exit(1);
+    }
+    int lines = count_lines(pf.buf, len);
+
+    printf("%s: %d lines, %zd bytes\n", path, lines, len);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        legacy_read_interrupts(path, legacy, &count);
+    }
+    print_result("fopen+fgets+strtok", now_ns() - start, iterations, lines);
+    if (count != lines) {
+        printf("  (old parser found %d rows)\n", count);
+    }
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        read_interrupts(&pf, &snapshots[0]);
+    }
+    print_result("pread+parse", now_ns() - start, iterations, lines);
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        count = parse_interrupts(pf.buf, len, &snapshots[1]);
+        asm volatile("" : : "r" (&snapshots[1]) : "memory");
+    }
+    print_result("parse only", now_ns() - start, iterations, lines);
+
+    start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        snapshot_delta(&snapshots[1], &snapshots[0]);
+        asm volatile("" : : "r" (&snapshots[1]) : "memory");
+    }
+    print_result("per-CPU matrix delta", now_ns() - start, iterations, lines);
+
+    if (count != lines) {
+        printf("  warning: parsed %d rows from %d lines\n", count, lines);
+    }
+
+    status = verify_cpu_columns(pf.buf, len, &snapshots[1]);
+    if (status == 0 && synthetic_rows > 0) {
+        status = verify_synthetic(&snapshots[1], synthetic_cpus, synthetic_rows);
+        if (status == 0) {
+            printf("  verified %d rows x %d CPUs, arena %zu bytes, read buffer %zu bytes\n",
+                   synthetic_rows, synthetic_cpus, snapshots[1].arena_size, pf.size);
+        }
+    }
+
+    snapshot_free(&snapshots[0]);
+    snapshot_free(&snapshots[1]);
+    proc_file_close(&pf);
+
+    return status;
+}
+
+int main(int argc, char **argv) {
+    int iterations = DEFAULT_ITERATIONS;
+    int synthetic_cpus[MAX_SYNTHETIC], synthetic_rows[MAX_SYNTHETIC];
+    int nsynthetic = 0;
+    int nfiles = 0;
+    int status = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && nsynthetic < MAX_SYNTHETIC) {
+            if (sscanf(argv[++i], "%dx%d", &synthetic_cpus[nsynthetic], &synthetic_rows[nsynthetic]) != 2 ||
+                synthetic_cpus[nsynthetic] <= 0 || synthetic_rows[nsynthetic] <= 0) {
+                iterations = 0;
+                break;
+            }
+            nsynthetic++;
+        } else if (argv[i][0] == '-') {
+            iterations = 0;
+            break;
+        } else {
+            nfiles++;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [-n iterations] [-s CPUSxROWS]... [file...]\n", argv[0]);
+        return 1;
+    }
+
+    printf("/proc/interrupts parser benchmark (%d iterations)\n\n", iterations);
+
+    if (nfiles > 0) {
+        for (i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-s") == 0) {
+                i++;
+            } else {
+                if (bench_file(argv[i], iterations, 0, 0) < 0) {
+                    status = 1;
+                }
+            }
+        }
+    } else if (nsynthetic == 0) {
+        for (size_t f = 0; f < sizeof(default_fixtures) / sizeof(default_fixtures[0]); f++) {
+            if (bench_file(default_fixtures[f], iterations, 0, 0) < 0) {
+                status = 1;
+            }
+        }
+    }
+
+    // Large synthetic tables are written to a temporary file, parsed through
+    // the same pread path and checked cell by cell
+    for (i = 0; i < nsynthetic; i++) {
+        char path[] = "/tmp/interrupts_synthetic_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+
+        if (write_synthetic(path, synthetic_cpus[i], synthetic_rows[i]) < 0 ||
+            bench_file(path, iterations, synthetic_cpus[i], synthetic_rows[i]) < 0) {
+            status = 1;
+        }
+        unlink(path);
+    }
+
+    return status;
+}
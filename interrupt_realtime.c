@@ -1,212 +1,449 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <time.h>
 #include <fcntl.h>
 #include <ctype.h>
-#include <sys/select.h>
-
-#define TRUE 1
-#define FALSE 0
-#define MAX_INTERRUPTS 256
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+#include "bench_core.h"
+#include "frame.h"
+#include "histogram.h"
+#include "load_gen.h"
+#include "monitor_loop.h"
+#include "proc_interrupts.h"
+#include "proc_stat.h"
+#include "trace.h"
+
+// Wakeup latency mode (-l): one thread per CPU sleeps until absolute
+// CLOCK_MONOTONIC deadlines, with clock_nanosleep() or a periodic timerfd,
+// and records how late it actually woke up. This is the timer interrupt to
+// userspace path a real-time guest depends on.
+#define DEFAULT_LATENCY_INTERVAL_US 1000
+#define DEFAULT_LATENCY_DURATION_S 10
 
 typedef struct {
-    int irq;
-    char name[64];
-    unsigned long long count;
-} InterruptInfo;
-
-volatile sig_atomic_t running = 1;
-
-static inline uint64_t get_system_time() {
-    uint64_t time;
-    asm volatile("mrs %0, cntvct_el0" : "=r" (time));
-    return time;
-}
-
-static inline void get_cpu_info(char* vendor, char* brand) {
-    uint64_t midr;
-    asm volatile("mrs %0, midr_el1" : "=r" (midr));
-    
-    uint8_t implementer = (midr >> 24) & 0xFF;
-    uint8_t variant = (midr >> 20) & 0xF;
-    uint8_t architecture = (midr >> 16) & 0xF;
-    uint16_t part_num = (midr >> 4) & 0xFFF;
-    
-    sprintf(vendor, "ARM%02X%01X%01X%03X", implementer, variant, architecture, part_num);
-    strcpy(brand, "ARM Processor");
-}
-
-int cpu_hv() {
-    uint64_t id_aa64pfr0;
-    asm volatile("mrs %0, id_aa64pfr0_el1" : "=r" (id_aa64pfr0));
-    return ((id_aa64pfr0 >> 40) & 0xF) != 0 ? TRUE : FALSE;
+    int interval_us;
+    int duration;
+    int fifo_priority;    // 0 to stay on SCHED_OTHER
+    int use_timerfd;
+    int max_cpus;
+    int dump_buckets;
+} LatencyConfig;
+
+// Written only by its thread until it has been joined
+typedef struct {
+    int cpu;
+    pthread_t thread;
+    const LatencyConfig *cfg;
+    int fifo;             // TRUE if SCHED_FIFO was granted
+    uint64_t overruns;    // deadlines that passed before the thread ran
+    Histogram hist;
+} __attribute__((aligned(64))) LatencyCpu;
+
+static volatile sig_atomic_t latency_stop;
+
+static void handle_latency_sigint(int sig) {
+    latency_stop = TRUE;
 }
 
-void cpu_write_vendor(char* vendor) {
-    char brand[49];
-    get_cpu_info(vendor, brand);
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-void read_interrupts(InterruptInfo *interrupts, int *count) {
-    FILE *fp = fopen("/proc/interrupts", "r");
-    if (fp == NULL) {
-        perror("Failed to open /proc/interrupts");
-        exit(1);
+static void *latency_thread(void *arg) {
+    LatencyCpu *lc = arg;
+    const LatencyConfig *cfg = lc->cfg;
+    uint64_t interval_ns = cfg->interval_us * 1000ULL;
+    double ticks_per_ns = (double)bench_clock_freq() / 1e9;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(lc->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "CPU %d: could not pin latency thread\n", lc->cpu);
+    }
+    if (cfg->fifo_priority > 0) {
+        struct sched_param param = { .sched_priority = cfg->fifo_priority };
+        lc->fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
     }
 
-    char line[256];
-    *count = 0;
-
-    // Skip the header line
-    fgets(line, sizeof(line), fp);
-
-    while (fgets(line, sizeof(line), fp) && *count < MAX_INTERRUPTS) {
-        InterruptInfo *info = &interrupts[*count];
-        char *token = strtok(line, " ");
-        if (token == NULL) continue;
-
-        // Remove colon from IRQ number
-        char *colon = strchr(token, ':');
-        if (colon) *colon = '\0';
-
-        info->irq = atoi(token);
+    int tfd = -1;
+    uint64_t deadline = monotonic_ns() + interval_ns;
+    if (cfg->use_timerfd) {
+        struct itimerspec its = {
+            .it_interval = { (time_t)(interval_ns / 1000000000ULL), (long)(interval_ns % 1000000000ULL) },
+            .it_value = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) },
+        };
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (tfd < 0 || timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+            fprintf(stderr, "CPU %d: timerfd: %s\n", lc->cpu, strerror(errno));
+            return NULL;
+        }
+    }
 
-        // Skip CPU-specific counts
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") != strlen(token)) {
+    while (!latency_stop) {
+        // The deadline is in CLOCK_MONOTONIC and the wakeup in clock ticks.
+        // Anchoring the two right before each sleep keeps calibration error
+        // down to the length of one interval.
+        uint64_t anchor_ns = monotonic_ns();
+        uint64_t anchor = get_system_time();
+        uint64_t expected = anchor + (uint64_t)((int64_t)(deadline - anchor_ns) * ticks_per_ns);
+
+        if (cfg->use_timerfd) {
+            uint64_t expirations;
+            if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
                 break;
             }
+            // Only the newest expiration can be timed; the rest were overrun
+            if (expirations > 1) {
+                lc->overruns += expirations - 1;
+                expected += (uint64_t)((expirations - 1) * interval_ns * ticks_per_ns);
+                deadline += (expirations - 1) * interval_ns;
+            }
+        } else {
+            struct timespec ts = { (time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL) };
+            if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+                continue;
+            }
         }
-
-        if (token == NULL) continue;
-
-        strncpy(info->name, token, sizeof(info->name) - 1);
-        info->name[sizeof(info->name) - 1] = '\0';
-
-        info->count = 0;
-        while ((token = strtok(NULL, " ")) != NULL) {
-            if (strspn(token, "0123456789") == strlen(token)) {
-                info->count += strtoull(token, NULL, 10);
+        uint64_t woke = get_system_time();
+
+        hist_record(&lc->hist, woke > expected ? woke - expected : 0);
+        deadline += interval_ns;
+
+        // clock_nanosleep() returns at once for a deadline already passed,
+        // so skip the ones missed instead of recording each as a wakeup
+        if (!cfg->use_timerfd) {
+            uint64_t now = monotonic_ns();
+            if (now > deadline) {
+                uint64_t missed = (now - deadline) / interval_ns + 1;
+                lc->overruns += missed;
+                deadline += missed * interval_ns;
             }
         }
-
-        (*count)++;
     }
 
-    fclose(fp);
+    if (tfd >= 0) {
+        close(tfd);
+    }
+    return NULL;
 }
 
-void signal_handler(int signum) {
-    running = 0;
+// Interrupts taken during the run, with the split over the measured CPUs
+static void print_latency_interrupts(InterruptSnapshot *after, const InterruptSnapshot *before,
+                                     const LatencyCpu *cpus, int ncpus, double seconds) {
+    if (!snapshot_same_layout(after, before)) {
+        printf("\n/proc/interrupts changed layout during the run; no deltas\n");
+        return;
+    }
+    snapshot_delta(after, before);
+
+    printf("\nInterrupts over the same %.3f s:\n", seconds);
+    printf("  %-16s %-20s %12s %12s", "IRQ", "Name", "Total", "Rate/s");
+    for (int n = 0; n < ncpus; n++) {
+        char label[16];
+        snprintf(label, sizeof(label), "CPU%d", cpus[n].cpu);
+        printf(" %10s", label);
+    }
+    printf("\n");
+    for (int i = 0; i < after->nirqs; i++) {
+        unsigned long long total = after->info[i].count - before->info[i].count;
+        if (total == 0) {
+            continue;
+        }
+        printf("  %-16s %-20.20s %12llu %12.1f", after->info[i].label, after->info[i].name, total, total / seconds);
+        for (int n = 0; n < ncpus; n++) {
+            int column = snapshot_cpu_column(after, cpus[n].cpu);
+            printf(" %10u", column >= 0 ? snapshot_cpu_delta(after, column, i) : 0);
+        }
+        printf("\n");
+    }
 }
 
-void generate_interrupts() {
-    // Generate disk I/O interrupt
-    FILE *file = fopen("/tmp/test_file", "w");
-    if (file != NULL) {
-        fprintf(file, "Test data for interrupt generation");
-        fclose(file);
-        remove("/tmp/test_file");
+static int run_latency(const LatencyConfig *cfg, ProcFile *proc_interrupts, InterruptSnapshot *before,
+                       InterruptSnapshot *after) {
+    char title[48];
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    int ncpus = CPU_COUNT(&allowed);
+    if (cfg->max_cpus > 0 && cfg->max_cpus < ncpus) {
+        ncpus = cfg->max_cpus;
     }
 
-    // Generate network-related interrupt (this might not work in all environments)
-    system("ping -c 1 localhost &>/dev/null");
+    LatencyCpu *cpus = aligned_alloc(64, ncpus * sizeof(LatencyCpu));
+    if (cpus == NULL) {
+        perror("aligned_alloc");
+        return 1;
+    }
+    memset(cpus, 0, ncpus * sizeof(LatencyCpu));
 
-    // Generate timer interrupt
-    usleep(1000);
-}
+    printf("\nWakeup latency: %d CPUs, %d us interval, %s, %s, %d s\n", ncpus, cfg->interval_us,
+           cfg->use_timerfd ? "timerfd" : "clock_nanosleep(TIMER_ABSTIME)",
+           cfg->fifo_priority > 0 ? "SCHED_FIFO" : "SCHED_OTHER", cfg->duration);
+    fflush(stdout);
 
-void clear_screen() {
-    printf("\033[2J");    // ANSI escape code to clear screen
-    printf("\033[H");     // Move cursor to home position
-}
+    signal(SIGINT, handle_latency_sigint);
+
+    read_interrupts(proc_interrupts, before);
+    uint64_t run_start = get_system_time();
+    int started = 0;
+    for (int cpu = 0; started < ncpus; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        cpus[started].cpu = cpu;
+        cpus[started].cfg = cfg;
+        hist_init(&cpus[started].hist);
+        if (pthread_create(&cpus[started].thread, NULL, latency_thread, &cpus[started]) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
 
-int main() {
-    char vendor[13] = {0};
-    InterruptInfo interrupts_prev[MAX_INTERRUPTS], interrupts_curr[MAX_INTERRUPTS];
-    int count_prev, count_curr;
+    for (int ms = 0; !latency_stop && ms < cfg->duration * 1000; ms += 100) {
+        usleep(100000);
+    }
+    latency_stop = TRUE;
+    for (int n = 0; n < started; n++) {
+        pthread_join(cpus[n].thread, NULL);
+    }
+    double seconds = (double)(get_system_time() - run_start) / (double)bench_clock_freq();
+    read_interrupts(proc_interrupts, after);
+
+    for (int n = 0; n < started; n++) {
+        LatencyCpu *lc = &cpus[n];
+        printf("\nCPU %d: %llu wakeups, %llu overruns%s\n", lc->cpu, (unsigned long long)lc->hist.total,
+               (unsigned long long)lc->overruns,
+               cfg->fifo_priority > 0 && !lc->fifo ? " (SCHED_FIFO refused, ran as SCHED_OTHER)" : "");
+        snprintf(title, sizeof(title), "  Wakeup latency CPU %d", lc->cpu);
+        print_histogram(&lc->hist, title, 1);
+        if (cfg->dump_buckets) {
+            print_histogram_buckets(&lc->hist);
+        }
+    }
+    print_latency_interrupts(after, before, cpus, started, seconds);
+
+    free(cpus);
+    return 0;
+}
 
-    signal(SIGINT, signal_handler);
+int main(int argc, char **argv) {
+    SystemSnapshot snapshots[2];
+    SystemSnapshot *prev = &snapshots[0], *curr = &snapshots[1];
+    SystemFiles files;
+    MonitorLoop loop;
+    MonitorEvent event;
+    FrameRenderer frame;
+    Trace trace;
+    const char *trace_path = NULL;
+    uint64_t period_ns = MONITOR_DEFAULT_PERIOD_NS;
+    // Background load, by default one disk, network and timer operation a second
+    LoadGen gens[LOAD_NUM_MODES];
+    LoadConfig load;
+    int modes[LOAD_NUM_MODES] = { LOAD_DISK, LOAD_UDP, LOAD_TIMER };
+    int nmodes = 3, ngens;
+    int latency_mode = FALSE;
+    LatencyConfig latency = { DEFAULT_LATENCY_INTERVAL_US, DEFAULT_LATENCY_DURATION_S, 0, FALSE, 0, FALSE };
+
+    load_config_init(&load, LOAD_UDP);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            period_ns = monitor_period_arg(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            nmodes = load_modes_parse(argv[++i], modes, LOAD_NUM_MODES);
+            if (nmodes < 0) {
+                fprintf(stderr, "unknown load mode in %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            load.rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            load.cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            latency_mode = TRUE;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            latency.interval_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            latency.duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            latency.fifo_priority = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-T") == 0) {
+            latency.use_timerfd = TRUE;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            latency.max_cpus = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            latency.dump_buckets = TRUE;
+        } else {
+            latency.interval_us = 0;
+            break;
+        }
+    }
+    if (latency.interval_us <= 0 || latency.duration <= 0) {
+        fprintf(stderr, "usage: %s [-p period_us] [-o trace-file] [-g modes|none] [-r ops_per_s] [-c cpu]\n"
+                        "       %s -l [-i interval_us] [-d seconds] [-f fifo_prio] [-T] [-w max_cpus] [-b] [-g ...]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
 
-    printf("ARM64 CPU and Interrupt Monitor:\n\n");
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
 
-    cpu_write_vendor(vendor);
-    printf("CPU Vendor: %s\n", vendor);
-    printf("Hypervisor present: %s\n", cpu_hv() ? "Yes" : "No");
+    print_system_info("CPU and Interrupt Monitor:\n");
+    if (latency_mode) {
+        InterruptSnapshot before, after;
+        ProcFile proc_interrupts;
+        if (proc_file_open(&proc_interrupts, "/proc/interrupts", PROC_FILE_BUF_SIZE) < 0 ||
+            snapshot_init(&before) < 0 || snapshot_init(&after) < 0) {
+            perror("Failed to set up /proc/interrupts snapshots");
+            return 1;
+        }
+        ngens = load_gens_start(gens, modes, nmodes, &load);
+        int ret = run_latency(&latency, &proc_interrupts, &before, &after);
+        if (ngens > 0) {
+            printf("\n");
+        }
+        load_gens_stop(gens, ngens);
+        snapshot_free(&before);
+        snapshot_free(&after);
+        proc_file_close(&proc_interrupts);
+        return ret;
+    }
+    printf("\nMonitoring interrupts every %.3f ms. Press 'r' to reset baseline, 'q' to quit.\n\n",
+           period_ns / 1000000.0);
 
-    // Get CPU frequency
-    uint64_t cntfrq;
-    asm volatile("mrs %0, cntfrq_el0" : "=r" (cntfrq));
-    double cntfrq_mhz = (double)cntfrq / 1000000;
+    if (system_files_open(&files) < 0) {
+        perror("Failed to open /proc/interrupts, /proc/softirqs and /proc/stat");
+        return 1;
+    }
+    if (system_snapshot_init(prev) < 0 || system_snapshot_init(curr) < 0) {
+        perror("Failed to allocate snapshots");
+        return 1;
+    }
 
-    printf("CPU Frequency: %.2f MHz\n", cntfrq_mhz);
-    printf("\nMonitoring interrupts. Press 'r' to reset baseline, 'q' to quit.\n\n");
+    if (trace_path != NULL) {
+        char config[64];
+        snprintf(config, sizeof(config), "period_us=%llu", (unsigned long long)(period_ns / 1000));
+        if (trace_open(&trace, trace_path, "interrupt_realtime", config) < 0) {
+            perror(trace_path);
+            return 1;
+        }
+    }
 
-    read_interrupts(interrupts_prev, &count_prev);
-    uint64_t last_check_time = get_system_time();
+    if (monitor_loop_init(&loop, period_ns) < 0) {
+        perror("Failed to set up the monitor loop");
+        return 1;
+    }
+    if (frame_init(&frame, STDOUT_FILENO) < 0) {
+        perror("Failed to allocate the frame buffer");
+        return 1;
+    }
+    // Frames bypass stdio, so anything printed so far goes out first
+    fflush(stdout);
 
-    int iteration = 0;
-    while (running) {
-        usleep(100000);  // Sleep for 100ms
+    read_system(&files, prev);
+    ngens = load_gens_start(gens, modes, nmodes, &load);
 
-        // Check for user input
-        fd_set fds;
-        struct timeval tv = {0, 0};
-        FD_ZERO(&fds);
-        FD_SET(STDIN_FILENO, &fds);
-        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0) {
-            char c = getchar();
-            if (tolower(c) == 'r') {
-                clear_screen();
+    int reset_baseline = FALSE;
+    while (monitor_loop_wait(&loop, &event) == 0 && event.type != MONITOR_QUIT) {
+        if (event.type == MONITOR_KEY) {
+            if (tolower(event.key) == 'r') {
                 printf("Resetting interrupt baseline...\n");
-                read_interrupts(interrupts_prev, &count_prev);
-                last_check_time = get_system_time();
-                continue;
-            } else if (tolower(c) == 'q') {
-                running = 0;
+                fflush(stdout);
+                frame_invalidate(&frame);
+                // Taken on the next tick, so every interval stays whole periods
+                reset_baseline = TRUE;
+            } else if (tolower(event.key) == 'q') {
                 break;
             }
-        }
-
-        // Generate interrupts every 10 iterations (approximately every 1 second)
-        if (++iteration % 10 == 0) {
-            generate_interrupts();
+            continue;
         }
 
         uint64_t current_time = get_system_time();
-        read_interrupts(interrupts_curr, &count_curr);
+        if (reset_baseline) {
+            read_system(&files, prev);
+            reset_baseline = FALSE;
+            continue;
+        }
+        read_system(&files, curr);
 
-        double elapsed_ms = (double)(current_time - last_check_time) / cntfrq_mhz / 1000.0;
+        double elapsed_ms = event.interval_ns / 1000000.0;
 
-        for (int i = 0; i < count_curr; i++) {
-            int prev_index = -1;
-            for (int j = 0; j < count_prev; j++) {
-                if (interrupts_curr[i].irq == interrupts_prev[j].irq) {
-                    prev_index = j;
-                    break;
-                }
-            }
+        // Per-CPU deltas are only meaningful while the row set is unchanged
+        int have_cpu_delta = snapshot_same_layout(&curr->irqs, &prev->irqs);
+        if (have_cpu_delta) {
+            snapshot_delta(&curr->irqs, &prev->irqs);
+        }
 
-            if (prev_index != -1) {
-                unsigned long long count_diff = interrupts_curr[i].count - interrupts_prev[prev_index].count;
-                if (count_diff > 0) {
-                    double avg_time_between_ms = elapsed_ms / count_diff;
+        if (trace_path != NULL) {
+            trace_record(&trace, current_time, TRACE_KIND_INTERVAL, 0,
+                         (uint64_t)(event.interval_ns * (double)bench_clock_freq() / 1e9));
+        }
 
-                    printf("Interrupt: IRQ %d, Name: %-20s, Count: %-5llu, Elapsed Time: %.3f ms, Avg Time Between: %.3f ms\n",
-                           interrupts_curr[i].irq, interrupts_curr[i].name, count_diff, elapsed_ms, avg_time_between_ms);
+        if (trace_path != NULL) {
+            const InterruptSnapshot *now = &curr->irqs, *before = &prev->irqs;
+            for (int i = 0; i < now->nirqs; i++) {
+                int prev_index = snapshot_find_row(before, &now->info[i], i);
+                if (prev_index == -1 || now->info[i].count == before->info[prev_index].count) {
+                    continue;
+                }
+                int label = trace_label(&trace, now->info[i].label);
+                if (label >= 0) {
+                    trace_record(&trace, current_time, TRACE_KIND_IRQ, label,
+                                 now->info[i].count - before->info[prev_index].count);
                 }
             }
         }
 
-        memcpy(interrupts_prev, interrupts_curr, sizeof(InterruptInfo) * count_curr);
-        count_prev = count_curr;
-        last_check_time = current_time;
+        frame_begin(&frame);
+        frame_put_str(&frame, "Dropped frames: ", 0);
+        frame_put_u64(&frame, frame.dropped, 0);
+        frame_put_str(&frame, ", missed ticks: ", 0);
+        frame_put_u64(&frame, loop.missed, 0);
+        frame_end_line(&frame);
+        frame_cpu_activity(&frame, curr, prev);
+        frame_interrupts(&frame, &curr->irqs, &prev->irqs, elapsed_ms, have_cpu_delta);
+        frame_flush(&frame);
+
+        SystemSnapshot *tmp = prev;
+        prev = curr;
+        curr = tmp;
     }
 
+    load_gens_stop(gens, ngens);
+    if (loop.missed > 0) {
+        printf("\n%llu refresh ticks were missed while processing ran late.\n", (unsigned long long)loop.missed);
+    }
+    if (frame.dropped > 0) {
+        printf("\n%llu of %llu frames were dropped while the console was behind.\n",
+               (unsigned long long)frame.dropped, (unsigned long long)frame.frames);
+    }
+    monitor_loop_close(&loop);
+    frame_free(&frame);
+    system_snapshot_free(prev);
+    system_snapshot_free(curr);
+    system_files_close(&files);
+    if (trace_path != NULL && trace_close(&trace) < 0) {
+        perror(trace_path);
+    }
     printf("\nInterrupt monitoring stopped.\n");
 
     return 0;
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "proc_interrupts.h"
+
+#define DEFAULT_ROWS 2000
+#define DEFAULT_ITERATIONS 200
+
+static const char *symbolic_labels[] = {
+    "NMI", "LOC", "SPU", "PMI", "IWI", "RTR", "RES", "CAL", "TLB", "TRM",
+    "THR", "DFR", "MCE", "MCP", "HYP", "ERR", "MIS", "PIN", "NPI", "PIW",
+    "IPI0", "IPI1", "IPI2", "IPI3", "IPI4", "IPI5", "IPI6", "Err",
+};
+
+#define NUM_SYMBOLIC (int)(sizeof(symbolic_labels) / sizeof(symbolic_labels[0]))
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Numeric IRQs followed by the symbolic rows, like a large x86 or GIC host.
+// labels holds the strings for the numeric rows.
+static void make_table(InterruptInfo *rows, char (*labels)[16], int nrows) {
+    int nnumeric = nrows > NUM_SYMBOLIC ? nrows - NUM_SYMBOLIC : 0;
+
+    for (int i = 0; i < nrows; i++) {
+        InterruptInfo *info = &rows[i];
+        if (i < nnumeric) {
+            snprintf(labels[i], sizeof(labels[i]), "%d", i);
+            info->label = labels[i];
+            info->irq = i;
+        } else {
+            info->label = symbolic_labels[i - nnumeric];
+            info->irq = -1;
+        }
+        info->key = irq_key(info->label, strlen(info->label));
+        info->name = "synthetic";
+        info->count = 0;
+    }
+}
+
+static void shuffle_table(InterruptInfo *rows, int nrows) {
+    for (int i = nrows - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        InterruptInfo tmp = rows[i];
+        rows[i] = rows[j];
+        rows[j] = tmp;
+    }
+}
+
+static void print_result(const char *label, uint64_t elapsed_ns, int iterations, int nrows, int wrong) {
+    double per_refresh = (double)elapsed_ns / iterations;
+    printf("  %-28s %12.1f ns/refresh %8.2f ns/row  mismatched rows: %d\n",
+           label, per_refresh, per_refresh / nrows, wrong);
+}
+
+// The nested scan on atoi() keys that the monitors used before
+static void bench_legacy(const InterruptInfo *prev, const InterruptInfo *curr, int nrows, int iterations) {
+    int *prev_irq = malloc(nrows * sizeof(int));
+    int *curr_irq = malloc(nrows * sizeof(int));
+    int wrong = 0;
+
+    for (int i = 0; i < nrows; i++) {
+        prev_irq[i] = atoi(prev[i].label);
+        curr_irq[i] = atoi(curr[i].label);
+    }
+
+    uint64_t start = now_ns();
+    for (int it = 0; it < iterations; it++) {
+        wrong = 0;
+        for (int i = 0; i < nrows; i++) {
+            int prev_index = -1;
+            for (int j = 0; j < nrows; j++) {
+                if (curr_irq[i] == prev_irq[j]) {
+                    prev_index = j;
+                    break;
+                }
+            }
+            if (prev_index < 0 || strcmp(prev[prev_index].label, curr[i].label) != 0) {
+                wrong++;
+            }
+        }
+        asm volatile("" : : "r" (wrong) : "memory");
+    }
+    print_result("nested scan, atoi key", now_ns() - start, iterations, nrows, wrong);
+
+    free(prev_irq);
+    free(curr_irq);
+}
+
+static void bench_indexed(const char *label, const InterruptInfo *prev, const InterruptInfo *curr,
+                          int nrows, int iterations) {
+    IrqIndex index;
+    int wrong = 0;
+
+    if (irq_index_init(&index, nrows) < 0) {
+        perror("irq_index_init");
+        exit(1);
+    }
+
+    // Rebuilding the index is part of every refresh, as in parse_interrupts()
+    uint64_t start = now_ns();
+    for (int it = 0; it < iterations; it++) {
+        irq_index_clear(&index);
+        for (int j = 0; j < nrows; j++) {
+            irq_index_insert(&index, prev[j].key, j);
+        }
+
+        wrong = 0;
+        for (int i = 0; i < nrows; i++) {
+            int prev_index = irq_index_find(&index, prev, nrows, &curr[i], i);
+            if (prev_index < 0 || strcmp(prev[prev_index].label, curr[i].label) != 0) {
+                wrong++;
+            }
+        }
+        asm volatile("" : : "r" (wrong) : "memory");
+    }
+    print_result(label, now_ns() - start, iterations, nrows, wrong);
+
+    irq_index_free(&index);
+}
+
+int main(int argc, char **argv) {
+    int nrows = DEFAULT_ROWS;
+    int iterations = DEFAULT_ITERATIONS;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0) {
+            nrows = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            iterations = atoi(argv[i + 1]);
+        }
+    }
+    if (nrows <= 0 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-r rows] [-n iterations]\n", argv[0]);
+        return 1;
+    }
+
+    InterruptInfo *prev = malloc(nrows * sizeof(InterruptInfo));
+    InterruptInfo *curr = malloc(nrows * sizeof(InterruptInfo));
+    InterruptInfo *shuffled = malloc(nrows * sizeof(InterruptInfo));
+    char (*labels)[16] = malloc(nrows * sizeof(*labels));
+    if (prev == NULL || curr == NULL || shuffled == NULL || labels == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    srand(1);
+    make_table(prev, labels, nrows);
+    memcpy(curr, prev, nrows * sizeof(InterruptInfo));
+    memcpy(shuffled, prev, nrows * sizeof(InterruptInfo));
+    shuffle_table(shuffled, nrows);
+
+    printf("IRQ row matching benchmark (%d rows, %d symbolic, %d iterations)\n\n",
+           nrows, nrows < NUM_SYMBOLIC ? nrows : NUM_SYMBOLIC, iterations);
+
+    bench_legacy(prev, curr, nrows, iterations);
+    bench_indexed("indexed, same row order", prev, curr, nrows, iterations);
+    bench_indexed("indexed, shuffled row order", prev, shuffled, nrows, iterations);
+
+    free(prev);
+    free(curr);
+    free(shuffled);
+    free(labels);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "bench_core.h"
+#include "isolation.h"
+
+#define PREFAULT_STACK_SIZE (256 * 1024)
+#define WARMUP_BATCH 100
+#define WARMUP_TOLERANCE 0.05
+
+static uint64_t warmup_batch[WARMUP_BATCH];
+
+void isolation_config_init(IsolationConfig *cfg) {
+    cfg->cpu = -1;
+    cfg->fifo_priority = 0;
+    cfg->lock_memory = FALSE;
+    cfg->warmup_samples = 0;
+}
+
+int isolation_parse_arg(IsolationConfig *cfg, int argc, char **argv, int *i) {
+    const char *arg = argv[*i];
+
+    if (strcmp(arg, "--mlock") == 0) {
+        cfg->lock_memory = TRUE;
+        return TRUE;
+    }
+    if (*i + 1 >= argc) {
+        return FALSE;
+    }
+
+    if (strcmp(arg, "--cpu") == 0) {
+        cfg->cpu = atoi(argv[++*i]);
+    } else if (strcmp(arg, "--fifo") == 0) {
+        cfg->fifo_priority = atoi(argv[++*i]);
+    } else if (strcmp(arg, "--warmup") == 0) {
+        cfg->warmup_samples = atoi(argv[++*i]);
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void isolation_prefault(void *buf, size_t size) {
+    volatile char *p = buf;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    for (size_t off = 0; off < size; off += page_size) {
+        p[off] = p[off];
+    }
+}
+
+// Grows the stack once so later calls never fault it in
+static void __attribute__((noinline)) prefault_stack() {
+    volatile char stack[PREFAULT_STACK_SIZE];
+    memset((char *)stack, 0, sizeof(stack));
+}
+
+void isolation_apply(const IsolationConfig *cfg, IsolationState *state) {
+    state->cpu = -1;
+    state->fifo_priority = 0;
+    state->memory_locked = FALSE;
+
+    if (cfg->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cfg->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+            state->cpu = cfg->cpu;
+        } else {
+            perror("sched_setaffinity");
+        }
+    }
+
+    if (cfg->fifo_priority > 0) {
+        struct sched_param param = { .sched_priority = cfg->fifo_priority };
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+            state->fifo_priority = cfg->fifo_priority;
+        } else {
+            perror("sched_setscheduler(SCHED_FIFO)");
+        }
+    }
+
+    if (cfg->lock_memory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+            state->memory_locked = TRUE;
+        } else {
+            perror("mlockall");
+        }
+    }
+
+    prefault_stack();
+    isolation_prefault(warmup_batch, sizeof(warmup_batch));
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void isolation_warmup(const IsolationConfig *cfg, uint64_t (*sample)(), WarmupResult *result) {
+    uint64_t previous = 0;
+
+    result->samples = 0;
+    result->stable = FALSE;
+    result->median = 0;
+
+    while (result->samples < cfg->warmup_samples) {
+        int n = cfg->warmup_samples - result->samples;
+        if (n > WARMUP_BATCH) n = WARMUP_BATCH;
+
+        for (int i = 0; i < n; i++) {
+            warmup_batch[i] = sample();
+        }
+        result->samples += n;
+
+        qsort(warmup_batch, n, sizeof(uint64_t), compare_u64);
+        result->median = warmup_batch[n / 2];
+
+        uint64_t diff = result->median > previous ? result->median - previous : previous - result->median;
+        if (previous > 0 && diff <= previous * WARMUP_TOLERANCE) {
+            result->stable = TRUE;
+            break;
+        }
+        previous = result->median;
+    }
+}
+
+void print_isolation(const IsolationState *state) {
+    int level = (state->cpu >= 0) + (state->fifo_priority > 0) + state->memory_locked;
+
+    printf("Isolation level %d/3: ", level);
+    if (state->cpu >= 0) {
+        printf("pinned to CPU %d", state->cpu);
+    } else {
+        printf("not pinned");
+    }
+    if (state->fifo_priority > 0) {
+        printf(", SCHED_FIFO %d", state->fifo_priority);
+    } else {
+        printf(", SCHED_OTHER");
+    }
+    printf(", memory %s\n", state->memory_locked ? "locked" : "not locked");
+}
+
+void print_warmup(const char *label, const WarmupResult *result) {
+    if (result->samples == 0) {
+        printf("%s warm-up: none\n", label);
+        return;
+    }
+    printf("%s warm-up: %d samples discarded, %s (last median %llu ticks)\n", label, result->samples,
+           result->stable ? "stable" : "not stable", (unsigned long long)result->median);
+}
@@ -0,0 +1,50 @@
+#ifndef ISOLATION_H
+#define ISOLATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared benchmark isolation: CPU pinning, SCHED_FIFO, memory locking,
+// pre-faulting and warm-up. Every step is best effort; what was actually
+// achieved is kept in IsolationState and printed next to the results, so
+// runs with different isolation are never compared by mistake.
+typedef struct {
+    int cpu;              // CPU to pin to, -1 to leave affinity alone
+    int fifo_priority;    // SCHED_FIFO priority, 0 to stay on SCHED_OTHER
+    int lock_memory;      // mlockall(MCL_CURRENT | MCL_FUTURE)
+    int warmup_samples;   // most samples to discard before measuring
+} IsolationConfig;
+
+typedef struct {
+    int cpu;              // pinned CPU, -1 if not pinned
+    int fifo_priority;    // SCHED_FIFO priority obtained, 0 if none
+    int memory_locked;
+} IsolationState;
+
+typedef struct {
+    int samples;          // samples discarded
+    int stable;           // TRUE if batch medians settled within the limit
+    uint64_t median;      // median of the last warm-up batch
+} WarmupResult;
+
+void isolation_config_init(IsolationConfig *cfg);
+
+// Consumes --cpu N, --fifo PRIO, --mlock and --warmup N at argv[*i],
+// advancing *i past any value. Returns FALSE for any other argument.
+int isolation_parse_arg(IsolationConfig *cfg, int argc, char **argv, int *i);
+
+// Applies cfg in order: affinity, scheduling class, memory lock, then
+// pre-faults the stack and warm-up buffer
+void isolation_apply(const IsolationConfig *cfg, IsolationState *state);
+
+// Touches every page of buf so first use doesn't take page faults
+void isolation_prefault(void *buf, size_t size);
+
+// Calls sample() in batches and discards the results until two batch
+// medians agree within 5% or cfg->warmup_samples is reached
+void isolation_warmup(const IsolationConfig *cfg, uint64_t (*sample)(), WarmupResult *result);
+
+void print_isolation(const IsolationState *state);
+void print_warmup(const char *label, const WarmupResult *result);
+
+#endif
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+
+#define DEFAULT_THRESHOLD_NS 10000
+#define DEFAULT_DURATION_S 10
+#define GAP_LOG_SIZE 1024
+#define LARGEST_GAPS 10
+
+// A stretch where the spinning thread didn't run: a host deschedule, a trap
+// into the hypervisor, or an interrupt in the guest
+typedef struct {
+    uint64_t start;
+    uint64_t duration;
+} Gap;
+
+// Written only by its spinner. The counters are read live by the reporter;
+// the histogram and gap log only after the spinner has stopped.
+typedef struct {
+    int cpu;
+    pthread_t thread;
+    uint64_t gaps;
+    uint64_t stolen;
+    uint64_t max_gap;
+    Histogram hist;
+    Gap log[GAP_LOG_SIZE];
+} __attribute__((aligned(64))) JitterCpu;
+
+static volatile sig_atomic_t stop;
+static uint64_t threshold;
+
+static void handle_sigint(int sig) {
+    stop = TRUE;
+}
+
+// Spins on the clock and keeps every interval longer than the threshold.
+// Anything between two reads that isn't the loop itself is time stolen
+// from this CPU.
+static void *spin(void *arg) {
+    JitterCpu *jc = arg;
+    uint64_t last = get_system_time();
+    while (!stop) {
+        uint64_t now = get_system_time();
+        uint64_t gap = now - last;
+        if (gap > threshold) {
+            jc->log[jc->gaps % GAP_LOG_SIZE] = (Gap){last, gap};
+            hist_record(&jc->hist, gap);
+            if (gap > jc->max_gap) jc->max_gap = gap;
+            __atomic_store_n(&jc->stolen, jc->stolen + gap, __ATOMIC_RELAXED);
+            __atomic_store_n(&jc->gaps, jc->gaps + 1, __ATOMIC_RELAXED);
+        }
+        last = now;
+    }
+    return NULL;
+}
+
+static double ticks_to_us(double ticks) {
+    return ticks * 1000000.0 / (double)bench_clock_freq();
+}
+
+static int compare_gap_desc(const void *a, const void *b) {
+    uint64_t x = ((const Gap *)a)->duration, y = ((const Gap *)b)->duration;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void print_largest_gaps(JitterCpu *jc, uint64_t run_start) {
+    int n = jc->gaps < GAP_LOG_SIZE ? (int)jc->gaps : GAP_LOG_SIZE;
+
+    qsort(jc->log, n, sizeof(Gap), compare_gap_desc);
+    printf("  Largest gaps%s:\n", jc->gaps > GAP_LOG_SIZE ? " (from the most recent 1024)" : "");
+    for (int i = 0; i < n && i < LARGEST_GAPS; i++) {
+        printf("    at %12.3f ms  %12.2f us\n", ticks_to_ms(jc->log[i].start - run_start),
+               ticks_to_us(jc->log[i].duration));
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t threshold_ns = DEFAULT_THRESHOLD_NS;
+    int duration = DEFAULT_DURATION_S;
+    int interval = 1;
+    int max_cpus = 0;
+    int dump_buckets = FALSE;
+    char title[32];
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold_ns = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            max_cpus = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        } else {
+            interval = 0;
+            break;
+        }
+    }
+    if (interval <= 0 || duration < 0 || threshold_ns == 0) {
+        fprintf(stderr, "usage: %s [-t threshold_ns] [-d seconds, 0 = until Ctrl-C] [-i interval_s] [-w max_cpus] [-b]\n"
+                        "       [--cpu N] [--fifo PRIO] [--mlock]\n", argv[0]);
+        return 1;
+    }
+
+    // Spinners take their CPUs from the affinity before --cpu narrows it
+    // to the reporter's
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+    threshold = threshold_ns * bench_clock_freq() / 1000000000ULL;
+    int ncpus = CPU_COUNT(&allowed);
+    if (max_cpus > 0 && max_cpus < ncpus) {
+        ncpus = max_cpus;
+    }
+
+    JitterCpu *cpus = aligned_alloc(64, ncpus * sizeof(JitterCpu));
+    if (cpus == NULL) {
+        perror("aligned_alloc");
+        return 1;
+    }
+    memset(cpus, 0, ncpus * sizeof(JitterCpu));
+
+    print_system_info("Hypervisor Jitter Detector:\n");
+    print_isolation(&iso_state);
+    if (iso_cfg.warmup_samples > 0) {
+        printf("Warm-up: not used, every interval the spinners see is a measurement\n");
+    }
+    printf("Threshold: %llu ns (%llu ticks), %d CPUs, %s\n", (unsigned long long)threshold_ns,
+           (unsigned long long)threshold, ncpus, duration > 0 ? "timed run" : "until Ctrl-C");
+
+    signal(SIGINT, handle_sigint);
+
+    uint64_t run_start = get_system_time();
+    for (int cpu = 0, n = 0; n < ncpus; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        cpus[n].cpu = cpu;
+        hist_init(&cpus[n].hist);
+        // Pinned before it first runs: a SCHED_FIFO spinner started on the
+        // reporter's CPU would never let the ones queued behind it migrate
+        pthread_attr_t attr;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_init(&attr);
+        if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) != 0 ||
+            pthread_create(&cpus[n].thread, &attr, spin, &cpus[n]) != 0) {
+            fprintf(stderr, "CPU %d: could not start pinned spinner\n", cpu);
+            return 1;
+        }
+        pthread_attr_destroy(&attr);
+        n++;
+    }
+
+    // The spinners inherit SCHED_FIFO. One level above them, the reporter
+    // can still preempt the spinner on its CPU to wake up.
+    if (iso_state.fifo_priority > 0) {
+        struct sched_param param = { .sched_priority = iso_state.fifo_priority + 1 };
+        if (param.sched_priority > sched_get_priority_max(SCHED_FIFO) ||
+            pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+            fprintf(stderr, "Could not raise the reporter above SCHED_FIFO %d; reports will lag\n",
+                    iso_state.fifo_priority);
+        }
+    }
+
+    // The reporter sleeps between reports, so it takes almost nothing from
+    // the spinner that shares its CPU
+    uint64_t *last_gaps = calloc(ncpus, sizeof(uint64_t));
+    uint64_t *last_stolen = calloc(ncpus, sizeof(uint64_t));
+    uint64_t last_report = run_start;
+    for (int elapsed = 0; !stop && (duration == 0 || elapsed < duration); elapsed += interval) {
+        sleep(interval);
+        uint64_t now = get_system_time();
+        double seconds = (double)(now - last_report) / (double)bench_clock_freq();
+        last_report = now;
+
+        printf("\n[%6.1f s]  %-5s %10s %14s %10s\n", ticks_to_ms(now - run_start) / 1000.0,
+               "CPU", "Gaps/s", "Stolen us/s", "Stolen %");
+        for (int n = 0; n < ncpus; n++) {
+            uint64_t gaps = __atomic_load_n(&cpus[n].gaps, __ATOMIC_RELAXED);
+            uint64_t stolen = __atomic_load_n(&cpus[n].stolen, __ATOMIC_RELAXED);
+            double stolen_us = ticks_to_us(stolen - last_stolen[n]) / seconds;
+
+            printf("            %-5d %10.1f %14.2f %9.4f%%\n", cpus[n].cpu,
+                   (gaps - last_gaps[n]) / seconds, stolen_us, stolen_us / 10000.0);
+            last_gaps[n] = gaps;
+            last_stolen[n] = stolen;
+        }
+        fflush(stdout);
+    }
+
+    stop = TRUE;
+    for (int n = 0; n < ncpus; n++) {
+        pthread_join(cpus[n].thread, NULL);
+    }
+    uint64_t run_end = get_system_time();
+    double run_seconds = (double)(run_end - run_start) / (double)bench_clock_freq();
+
+    printf("\nSummary over %.1f s:\n", run_seconds);
+    for (int n = 0; n < ncpus; n++) {
+        JitterCpu *jc = &cpus[n];
+        printf("\nCPU %d: %llu gaps (%.1f/s), stolen %.2f us/s (%.4f%%), max gap %.2f us\n", jc->cpu,
+               (unsigned long long)jc->gaps, jc->gaps / run_seconds, ticks_to_us(jc->stolen) / run_seconds,
+               ticks_to_us(jc->stolen) / run_seconds / 10000.0, ticks_to_us(jc->max_gap));
+        snprintf(title, sizeof(title), "  Gap length CPU %d", jc->cpu);
+        print_histogram(&jc->hist, title, 1);
+        if (dump_buckets) {
+            print_histogram_buckets(&jc->hist);
+        }
+        print_largest_gaps(jc, run_start);
+    }
+
+    free(last_gaps);
+    free(last_stolen);
+    free(cpus);
+    return 0;
+}
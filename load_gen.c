@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+
+#include "bench_core.h"
+#include "load_gen.h"
+
+#define LOAD_BLOCK_SIZE 4096
+#define LOAD_DISK_BLOCKS 256          // the disk mode cycles over a 1 MiB region
+#define LOAD_TIMER_NS 20000           // one-shot timer length
+#define LOAD_UDP_MAX 65507
+
+const char *load_mode_names[LOAD_NUM_MODES] = {
+    "udp", "tcp", "disk", "timer", "ipi", "membarrier",
+};
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void load_config_init(LoadConfig *cfg, int mode) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->mode = mode;
+    cfg->rate = 1.0;
+    cfg->cpu = -1;
+    cfg->peer_cpu = -1;
+    cfg->bytes = LOAD_BLOCK_SIZE;
+    cfg->dir = "/var/tmp";
+}
+
+int load_mode_parse(const char *name) {
+    for (int mode = 0; mode < LOAD_NUM_MODES; mode++) {
+        if (strcmp(name, load_mode_names[mode]) == 0) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+int load_modes_parse(const char *list, int *modes, int max) {
+    char name[32];
+    int n = 0;
+
+    if (strcmp(list, "none") == 0) {
+        return 0;
+    }
+    while (*list != '\0') {
+        size_t len = strcspn(list, ",");
+        if (len == 0 || len >= sizeof(name) || n == max) {
+            return -1;
+        }
+        memcpy(name, list, len);
+        name[len] = '\0';
+        if ((modes[n++] = load_mode_parse(name)) < 0) {
+            return -1;
+        }
+        list += len + (list[len] == ',');
+    }
+    return n;
+}
+
+static int pin_self(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+// First allowed CPU other than avoid
+static int other_cpu(int avoid) {
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set) && cpu != avoid) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+static int read_full(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int setup_udp(LoadGen *gen) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+
+    if (gen->cfg.bytes > LOAD_UDP_MAX) gen->cfg.bytes = LOAD_UDP_MAX;
+    gen->fds[0] = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    gen->fds[1] = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (gen->fds[0] < 0 || gen->fds[1] < 0 ||
+        bind(gen->fds[0], (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(gen->fds[0], (struct sockaddr *)&addr, &addr_len) < 0 ||
+        connect(gen->fds[1], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int setup_tcp(LoadGen *gen) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    int one = 1;
+
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    gen->fds[1] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || gen->fds[1] < 0 ||
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        listen(listener, 1) < 0 ||
+        connect(gen->fds[1], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (listener >= 0) close(listener);
+        return -1;
+    }
+    gen->fds[0] = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    close(listener);
+    if (gen->fds[0] < 0) {
+        return -1;
+    }
+    // Every write goes out as its own segment
+    setsockopt(gen->fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 0;
+}
+
+// An unnamed file in dir, so generators and tool instances never share
+// one, and nothing is left behind if the process dies
+static int open_scratch(const char *dir, int flags) {
+    int fd = open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC | flags, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR)) {
+        return fd;
+    }
+
+    // No O_TMPFILE here: a unique name, unlinked straight away
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/load_gen.XXXXXX", dir);
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (flags != 0 && fcntl(fd, F_SETFL, flags) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static int setup_disk(LoadGen *gen) {
+    // O_DIRECT needs block-aligned buffers and lengths
+    gen->cfg.bytes = (gen->cfg.bytes + LOAD_BLOCK_SIZE - 1) / LOAD_BLOCK_SIZE * LOAD_BLOCK_SIZE;
+    free(gen->buf);
+    if (posix_memalign((void **)&gen->buf, LOAD_BLOCK_SIZE, gen->cfg.bytes) != 0) {
+        gen->buf = NULL;
+        return -1;
+    }
+    memset(gen->buf, 0xa5, gen->cfg.bytes);
+
+    gen->direct = TRUE;
+    gen->fds[0] = open_scratch(gen->cfg.dir, O_DIRECT);
+    if (gen->fds[0] < 0 && errno == EINVAL) {
+        // tmpfs and some other filesystems refuse O_DIRECT; fdatasync still
+        // reaches the device where there is one
+        gen->direct = FALSE;
+        gen->fds[0] = open_scratch(gen->cfg.dir, 0);
+    }
+    return gen->fds[0] < 0 ? -1 : 0;
+}
+
+static void *ipi_peer(void *arg) {
+    LoadGen *gen = arg;
+    uint64_t value;
+
+    if (gen->cfg.peer_cpu >= 0) {
+        pin_self(gen->cfg.peer_cpu);
+    }
+    // Every ping gets its reply before stop is checked, or a ping in flight
+    // when stop is set leaves load_main waiting for it
+    while (read(gen->fds[0], &value, sizeof(value)) == sizeof(value)) {
+        value = 1;
+        if (write(gen->fds[1], &value, sizeof(value)) != sizeof(value) || gen->stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int setup_ipi(LoadGen *gen) {
+    if (gen->cfg.peer_cpu < 0) {
+        gen->cfg.peer_cpu = other_cpu(gen->cfg.cpu >= 0 ? gen->cfg.cpu : sched_getcpu());
+    }
+    gen->fds[0] = eventfd(0, EFD_CLOEXEC);
+    gen->fds[1] = eventfd(0, EFD_CLOEXEC);
+    if (gen->fds[0] < 0 || gen->fds[1] < 0) {
+        return -1;
+    }
+    int err = pthread_create(&gen->peer, NULL, ipi_peer, gen);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int setup_membarrier() {
+    int supported = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+    if (supported < 0 || !(supported & MEMBARRIER_CMD_PRIVATE_EXPEDITED)) {
+        errno = ENOSYS;
+        return -1;
+    }
+    return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0);
+}
+
+static int run_op(LoadGen *gen) {
+    uint64_t value = 1;
+
+    switch (gen->cfg.mode) {
+        case LOAD_UDP:
+            if (send(gen->fds[1], gen->buf, gen->cfg.bytes, 0) < 0) return -1;
+            return recv(gen->fds[0], gen->buf, gen->cfg.bytes, 0) < 0 ? -1 : 0;
+        case LOAD_TCP:
+            if (write_full(gen->fds[1], gen->buf, gen->cfg.bytes) < 0) return -1;
+            return read_full(gen->fds[0], gen->buf, gen->cfg.bytes);
+        case LOAD_DISK: {
+            off_t offset = (off_t)(gen->ops % LOAD_DISK_BLOCKS) * gen->cfg.bytes;
+            if (pwrite(gen->fds[0], gen->buf, gen->cfg.bytes, offset) < 0) return -1;
+            return fdatasync(gen->fds[0]);
+        }
+        case LOAD_TIMER: {
+            struct itimerspec its = { .it_value = { 0, LOAD_TIMER_NS } };
+            if (timerfd_settime(gen->fds[0], 0, &its, NULL) < 0) return -1;
+            return read(gen->fds[0], &value, sizeof(value)) == sizeof(value) ? 0 : -1;
+        }
+        case LOAD_IPI:
+            if (write(gen->fds[0], &value, sizeof(value)) != sizeof(value)) return -1;
+            return read(gen->fds[1], &value, sizeof(value)) == sizeof(value) ? 0 : -1;
+        case LOAD_MEMBARRIER:
+            return syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) < 0 ? -1 : 0;
+    }
+    return -1;
+}
+
+// Sleeps until the absolute deadline, or returns FALSE early once stopped
+static int wait_until(LoadGen *gen, uint64_t deadline_ns) {
+    struct pollfd pfd = { .fd = gen->fds[3], .events = POLLIN };
+
+    for (;;) {
+        uint64_t now = monotonic_ns();
+        if (gen->stop) {
+            return FALSE;
+        }
+        if (now >= deadline_ns) {
+            return TRUE;
+        }
+        uint64_t left = deadline_ns - now;
+        struct timespec ts = { (time_t)(left / 1000000000ULL), (long)(left % 1000000000ULL) };
+        ppoll(&pfd, 1, &ts, NULL);
+    }
+}
+
+static void *load_main(void *arg) {
+    LoadGen *gen = arg;
+    uint64_t period_ns = (uint64_t)(1e9 / gen->cfg.rate);
+
+    if (gen->cfg.cpu >= 0) {
+        pin_self(gen->cfg.cpu);
+    }
+
+    gen->start_ns = monotonic_ns();
+    uint64_t next = gen->start_ns + period_ns;
+    // Failed operations count toward count too, so a burst whose every
+    // operation fails still ends
+    while (gen->cfg.count == 0 || gen->ops + gen->errors < gen->cfg.count) {
+        if (!wait_until(gen, next)) {
+            break;
+        }
+        uint64_t op_start = get_system_time();
+        int ret = run_op(gen);
+        if (gen->cfg.log != NULL) {
+            SampleRecord rec = { op_start, get_system_time() - op_start, gen->cfg.mode,
+                                 ret == 0 ? LOAD_OP_DONE : LOAD_OP_FAILED };
+            sample_ring_push(gen->cfg.log, &rec);
+        }
+        if (ret == 0) {
+            gen->ops++;
+        } else {
+            gen->errors++;
+        }
+
+        // Absolute schedule, but a generator that fell a whole period behind
+        // restarts from now instead of bursting to catch up
+        next += period_ns;
+        uint64_t now = monotonic_ns();
+        if (now > next + period_ns) {
+            gen->late += (now - next) / period_ns;
+            next = now;
+        }
+    }
+    gen->end_ns = monotonic_ns();
+    __atomic_store_n(&gen->done, TRUE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void release(LoadGen *gen) {
+    for (int i = 0; i < 4; i++) {
+        if (gen->fds[i] >= 0) {
+            close(gen->fds[i]);
+            gen->fds[i] = -1;
+        }
+    }
+    free(gen->buf);
+    gen->buf = NULL;
+}
+
+int load_gen_start(LoadGen *gen, const LoadConfig *cfg) {
+    int ret = 0;
+
+    memset(gen, 0, sizeof(*gen));
+    gen->cfg = *cfg;
+    if (gen->cfg.rate <= 0) gen->cfg.rate = 1.0;
+    if (gen->cfg.bytes == 0) gen->cfg.bytes = 1;
+    for (int i = 0; i < 4; i++) {
+        gen->fds[i] = -1;
+    }
+
+    gen->buf = calloc(1, gen->cfg.bytes);
+    gen->fds[3] = eventfd(0, EFD_CLOEXEC);
+    if (gen->buf == NULL || gen->fds[3] < 0) {
+        perror("load generator");
+        release(gen);
+        return -1;
+    }
+
+    switch (gen->cfg.mode) {
+        case LOAD_UDP: ret = setup_udp(gen); break;
+        case LOAD_TCP: ret = setup_tcp(gen); break;
+        case LOAD_DISK: ret = setup_disk(gen); break;
+        case LOAD_TIMER:
+            gen->fds[0] = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            ret = gen->fds[0] < 0 ? -1 : 0;
+            break;
+        case LOAD_IPI: ret = setup_ipi(gen); break;
+        case LOAD_MEMBARRIER: ret = setup_membarrier(); break;
+        default:
+            errno = EINVAL;
+            ret = -1;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Load generator %s: %s\n",
+                gen->cfg.mode >= 0 && gen->cfg.mode < LOAD_NUM_MODES ? load_mode_names[gen->cfg.mode] : "?",
+                strerror(errno));
+        release(gen);
+        return -1;
+    }
+
+    int err = pthread_create(&gen->thread, NULL, load_main, gen);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        load_gen_stop(gen);
+        return -1;
+    }
+    return 0;
+}
+
+void load_gen_stop(LoadGen *gen) {
+    uint64_t value = 1;
+
+    __atomic_store_n(&gen->stop, TRUE, __ATOMIC_RELEASE);
+    if (gen->fds[3] >= 0 && write(gen->fds[3], &value, sizeof(value)) < 0) {
+        perror("load generator stop");
+    }
+    if (gen->thread != 0) {
+        pthread_join(gen->thread, NULL);
+    }
+    // The peer only wakes for a ping, so send one more to let it see stop
+    if (gen->cfg.mode == LOAD_IPI && gen->peer != 0) {
+        if (write(gen->fds[0], &value, sizeof(value)) < 0) {
+            perror("load generator stop");
+        }
+        pthread_join(gen->peer, NULL);
+    }
+    release(gen);
+}
+
+double load_gen_rate(const LoadGen *gen) {
+    if (gen->end_ns <= gen->start_ns) {
+        return 0;
+    }
+    return gen->ops * 1e9 / (gen->end_ns - gen->start_ns);
+}
+
+void print_load_gen(const LoadGen *gen) {
+    const LoadConfig *cfg = &gen->cfg;
+
+    printf("Load %-10s target %10.1f ops/s, achieved %10.1f ops/s (%llu ops in %.3f s",
+           load_mode_names[cfg->mode], cfg->rate, load_gen_rate(gen), (unsigned long long)gen->ops,
+           (gen->end_ns - gen->start_ns) / 1e9);
+    if (gen->errors > 0) {
+        printf(", %llu errors", (unsigned long long)gen->errors);
+    }
+    if (gen->late > 0) {
+        printf(", %llu periods late", (unsigned long long)gen->late);
+    }
+    printf(")\n");
+
+    if (cfg->mode == LOAD_DISK && !gen->direct) {
+        printf("  %s does not support O_DIRECT; writes were buffered\n", cfg->dir);
+    }
+    if (cfg->mode == LOAD_IPI && (cfg->peer_cpu < 0 || cfg->peer_cpu == cfg->cpu)) {
+        printf("  no second CPU: wakeups stayed on one CPU and sent no IPIs\n");
+    }
+}
+
+int load_gens_start(LoadGen *gens, const int *modes, int nmodes, const LoadConfig *base) {
+    int ngens = 0;
+
+    for (int i = 0; i < nmodes; i++) {
+        LoadConfig cfg = *base;
+        cfg.mode = modes[i];
+        if (load_gen_start(&gens[ngens], &cfg) == 0) {
+            ngens++;
+        }
+    }
+    return ngens;
+}
+
+void load_gens_stop(LoadGen *gens, int ngens) {
+    for (int i = 0; i < ngens; i++) {
+        load_gen_stop(&gens[i]);
+        print_load_gen(&gens[i]);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef LOAD_GEN_H
+#define LOAD_GEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "sample_ring.h"
+
+// In-process interrupt load generator. Each generator is one thread that
+// repeats a single operation on an absolute CLOCK_MONOTONIC schedule, so
+// the target rate holds no matter how long an operation takes, and counts
+// what it actually managed. Nothing forks or execs, so the only scheduler
+// and page-fault activity is the operation's own.
+enum {
+    LOAD_UDP,             // datagram to a loopback socket, then receive it
+    LOAD_TCP,             // write to a loopback connection, then read it back
+    LOAD_DISK,            // O_DIRECT block write plus fdatasync
+    LOAD_TIMER,           // short one-shot timerfd expiration
+    LOAD_IPI,             // wake a thread on another CPU and wait for its reply
+    LOAD_MEMBARRIER,      // expedited membarrier: IPIs every CPU running us
+    LOAD_NUM_MODES
+};
+
+extern const char *load_mode_names[LOAD_NUM_MODES];
+
+// Operation log records: timestamp is when the operation started, value
+// how many ticks it took, source the mode
+enum {
+    LOAD_OP_DONE,
+    LOAD_OP_FAILED
+};
+
+typedef struct {
+    int mode;
+    double rate;          // target operations per second
+    uint64_t count;       // stop after this many attempts, failed or not; 0 to run until stopped
+    int cpu;              // CPU to run on, -1 to leave affinity alone
+    int peer_cpu;         // LOAD_IPI: CPU of the woken thread, -1 for another allowed one
+    size_t bytes;         // payload for UDP/TCP, block size for disk
+    const char *dir;      // LOAD_DISK: directory for the unnamed scratch file
+    SampleRing *log;      // when set, every operation is pushed here
+} LoadConfig;
+
+typedef struct {
+    LoadConfig cfg;
+    pthread_t thread;
+    pthread_t peer;
+    int fds[4];           // mode resources, -1 when unused
+    char *buf;
+    int direct;           // LOAD_DISK: TRUE if O_DIRECT was accepted
+    volatile int stop;
+    volatile int done;    // set by the thread once count is reached
+    uint64_t ops;
+    uint64_t errors;
+    uint64_t late;        // operations that started a whole period late
+    uint64_t start_ns;
+    uint64_t end_ns;
+} LoadGen;
+
+// Defaults: 1 operation per second, unpinned, 4 KiB
+void load_config_init(LoadConfig *cfg, int mode);
+
+// Looks up a mode by name; returns -1 if there is none
+int load_mode_parse(const char *name);
+
+// Parses a comma-separated mode list into modes[]. "none" gives an empty
+// list. Returns the number of modes, or -1 on an unknown name.
+int load_modes_parse(const char *list, int *modes, int max);
+
+// Sets up the mode's resources and starts the generator thread.
+// Returns -1 with an error printed if the mode isn't available here.
+int load_gen_start(LoadGen *gen, const LoadConfig *cfg);
+
+// Stops the generator, waits for it and releases its resources
+void load_gen_stop(LoadGen *gen);
+
+// Operations per second actually achieved between start and stop
+double load_gen_rate(const LoadGen *gen);
+
+void print_load_gen(const LoadGen *gen);
+
+// Starts one generator per mode from a shared base configuration and
+// returns how many started; load_gens_stop stops and reports them all
+int load_gens_start(LoadGen *gens, const int *modes, int nmodes, const LoadConfig *base);
+void load_gens_stop(LoadGen *gens, int ngens);
+
+#endif
@@ -0,0 +1,542 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "bench_core.h"
+#include "report.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define DEFAULT_ARRAY_MIB 64
+#define DEFAULT_TRIALS 10
+#define MAX_TRIALS 100
+#define BARRIER_SPINS 1000000     // spins before a waiting thread starts yielding
+#define SATURATION 0.9            // share of peak that counts as saturated
+#define SCALAR 3.0
+
+// Vector width and the stores the kernels are built from. Each loop step
+// handles two vectors, so the AArch64 non-temporal store can be one STNP.
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define SIMD_NAME "NEON"
+#define VEC_DOUBLES 2
+typedef float64x2_t vec_t;
+#define vec_load(p) vld1q_f64(p)
+#define vec_set1(x) vdupq_n_f64(x)
+#define vec_add(a, b) vaddq_f64(a, b)
+#define vec_mul(a, b) vmulq_f64(a, b)
+static inline void vec_store_pair(double *p, vec_t v0, vec_t v1) {
+    vst1q_f64(p, v0);
+    vst1q_f64(p + 2, v1);
+}
+static inline void vec_stream_pair(double *p, vec_t v0, vec_t v1) {
+    asm volatile("stnp %q0, %q1, [%2]" : : "w" (v0), "w" (v1), "r" (p) : "memory");
+}
+static inline void vec_stream_fence() {
+    asm volatile("dmb ish" : : : "memory");
+}
+static inline double vec_sum(vec_t v) {
+    return vaddvq_f64(v);
+}
+#define HAVE_STREAM_STORES TRUE
+#elif defined(__AVX2__)
+#define SIMD_NAME "AVX2"
+#define VEC_DOUBLES 4
+typedef __m256d vec_t;
+#define vec_load(p) _mm256_load_pd(p)
+#define vec_set1(x) _mm256_set1_pd(x)
+#define vec_add(a, b) _mm256_add_pd(a, b)
+#define vec_mul(a, b) _mm256_mul_pd(a, b)
+static inline void vec_store_pair(double *p, vec_t v0, vec_t v1) {
+    _mm256_store_pd(p, v0);
+    _mm256_store_pd(p + 4, v1);
+}
+static inline void vec_stream_pair(double *p, vec_t v0, vec_t v1) {
+    _mm256_stream_pd(p, v0);
+    _mm256_stream_pd(p + 4, v1);
+}
+static inline void vec_stream_fence() {
+    _mm_sfence();
+}
+static inline double vec_sum(vec_t v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+#define HAVE_STREAM_STORES TRUE
+#elif defined(__SSE2__)
+#define SIMD_NAME "SSE2"
+#define VEC_DOUBLES 2
+typedef __m128d vec_t;
+#define vec_load(p) _mm_load_pd(p)
+#define vec_set1(x) _mm_set1_pd(x)
+#define vec_add(a, b) _mm_add_pd(a, b)
+#define vec_mul(a, b) _mm_mul_pd(a, b)
+static inline void vec_store_pair(double *p, vec_t v0, vec_t v1) {
+    _mm_store_pd(p, v0);
+    _mm_store_pd(p + 2, v1);
+}
+static inline void vec_stream_pair(double *p, vec_t v0, vec_t v1) {
+    _mm_stream_pd(p, v0);
+    _mm_stream_pd(p + 2, v1);
+}
+static inline void vec_stream_fence() {
+    _mm_sfence();
+}
+static inline double vec_sum(vec_t v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+#define HAVE_STREAM_STORES TRUE
+#else
+#define SIMD_NAME "scalar"
+#define VEC_DOUBLES 1
+typedef double vec_t;
+#define vec_load(p) (*(p))
+#define vec_set1(x) (x)
+#define vec_add(a, b) ((a) + (b))
+#define vec_mul(a, b) ((a) * (b))
+static inline void vec_store_pair(double *p, vec_t v0, vec_t v1) {
+    p[0] = v0;
+    p[1] = v1;
+}
+#define vec_stream_pair vec_store_pair
+static inline void vec_stream_fence() {
+}
+static inline double vec_sum(vec_t v) {
+    return v;
+}
+#define HAVE_STREAM_STORES FALSE
+#endif
+
+#define STEP (2 * VEC_DOUBLES)
+
+typedef struct {
+    int cpu;
+    double *a, *b, *c;
+    size_t array_bytes;
+    double sink;          // read kernel result, so the loads stay
+    uint64_t start[MAX_TRIALS];
+    uint64_t end[MAX_TRIALS];
+    pthread_t thread;
+} BwWorker;
+
+// Spinning barrier: every thread leaves within a few cycles of the last
+// arrival, which a futex wakeup can't promise
+typedef struct {
+    int count;
+    int waiting;
+    int phase;
+} SpinBarrier;
+
+typedef struct {
+    const char *name;
+    int bytes;            // bytes moved per element, STREAM counting
+    void (*run)(BwWorker *w, size_t n);
+} BwKernel;
+
+static SpinBarrier barrier;
+static const BwKernel *run_kernel;
+static int run_trials;
+
+static void barrier_wait(SpinBarrier *b) {
+    int phase = __atomic_load_n(&b->phase, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&b->waiting, 1, __ATOMIC_ACQ_REL) == b->count) {
+        __atomic_store_n(&b->waiting, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->phase, phase + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    // Yield after a while so a shared CPU still lets the others arrive
+    for (long spins = 0; __atomic_load_n(&b->phase, __ATOMIC_ACQUIRE) == phase; spins++) {
+        if (spins > BARRIER_SPINS) {
+            sched_yield();
+        }
+    }
+}
+
+// The kernels are instantiated twice, with plain and non-temporal stores;
+// nt is a constant in each copy, so the branch disappears
+static inline __attribute__((always_inline)) void store_pair(double *p, vec_t v0, vec_t v1, int nt) {
+    if (nt) {
+        vec_stream_pair(p, v0, v1);
+    } else {
+        vec_store_pair(p, v0, v1);
+    }
+}
+
+static inline __attribute__((always_inline)) void copy(BwWorker *w, size_t n, int nt) {
+    for (size_t i = 0; i < n; i += STEP) {
+        store_pair(w->c + i, vec_load(w->a + i), vec_load(w->a + i + VEC_DOUBLES), nt);
+    }
+}
+
+static inline __attribute__((always_inline)) void scale(BwWorker *w, size_t n, int nt) {
+    vec_t s = vec_set1(SCALAR);
+    for (size_t i = 0; i < n; i += STEP) {
+        store_pair(w->b + i, vec_mul(s, vec_load(w->c + i)), vec_mul(s, vec_load(w->c + i + VEC_DOUBLES)), nt);
+    }
+}
+
+static inline __attribute__((always_inline)) void add(BwWorker *w, size_t n, int nt) {
+    for (size_t i = 0; i < n; i += STEP) {
+        store_pair(w->c + i, vec_add(vec_load(w->a + i), vec_load(w->b + i)),
+                   vec_add(vec_load(w->a + i + VEC_DOUBLES), vec_load(w->b + i + VEC_DOUBLES)), nt);
+    }
+}
+
+static inline __attribute__((always_inline)) void triad(BwWorker *w, size_t n, int nt) {
+    vec_t s = vec_set1(SCALAR);
+    for (size_t i = 0; i < n; i += STEP) {
+        store_pair(w->a + i, vec_add(vec_load(w->b + i), vec_mul(s, vec_load(w->c + i))),
+                   vec_add(vec_load(w->b + i + VEC_DOUBLES), vec_mul(s, vec_load(w->c + i + VEC_DOUBLES))), nt);
+    }
+}
+
+static inline __attribute__((always_inline)) void write_only(BwWorker *w, size_t n, int nt) {
+    vec_t s = vec_set1(SCALAR);
+    for (size_t i = 0; i < n; i += STEP) {
+        store_pair(w->a + i, s, s, nt);
+    }
+}
+
+static void kernel_read(BwWorker *w, size_t n) {
+    vec_t sum0 = vec_set1(0.0), sum1 = vec_set1(0.0);
+    for (size_t i = 0; i < n; i += STEP) {
+        sum0 = vec_add(sum0, vec_load(w->a + i));
+        sum1 = vec_add(sum1, vec_load(w->a + i + VEC_DOUBLES));
+    }
+    w->sink = vec_sum(vec_add(sum0, sum1));
+}
+
+#define KERNEL_PAIR(name) \
+    static void kernel_##name(BwWorker *w, size_t n) { name(w, n, FALSE); } \
+    static void kernel_##name##_nt(BwWorker *w, size_t n) { name(w, n, TRUE); vec_stream_fence(); }
+
+KERNEL_PAIR(copy)
+KERNEL_PAIR(scale)
+KERNEL_PAIR(add)
+KERNEL_PAIR(triad)
+KERNEL_PAIR(write_only)
+
+static const BwKernel kernels[] = {
+    {"copy", 16, kernel_copy},
+    {"scale", 16, kernel_scale},
+    {"add", 24, kernel_add},
+    {"triad", 24, kernel_triad},
+    {"read", 8, kernel_read},
+    {"write", 8, kernel_write_only},
+    {"copy_nt", 16, kernel_copy_nt},
+    {"scale_nt", 16, kernel_scale_nt},
+    {"add_nt", 24, kernel_add_nt},
+    {"triad_nt", 24, kernel_triad_nt},
+    {"write_nt", 8, kernel_write_only_nt},
+};
+
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static double *map_array(size_t bytes) {
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return mem;
+}
+
+// Pins itself, maps and first-touches its arrays on its own CPU (so they
+// come from the local node), then runs every trial in step with the others
+static void *bw_worker(void *arg) {
+    BwWorker *w = arg;
+    size_t n = w->array_bytes / sizeof(double);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Cannot pin a worker to CPU %d\n", w->cpu);
+        exit(1);
+    }
+    if (w->a == NULL) {
+        w->a = map_array(w->array_bytes);
+        w->b = map_array(w->array_bytes);
+        w->c = map_array(w->array_bytes);
+        for (size_t i = 0; i < n; i++) {
+            w->a[i] = 1.0;
+            w->b[i] = 2.0;
+            w->c[i] = 0.0;
+        }
+    }
+
+    for (int t = 0; t < run_trials; t++) {
+        barrier_wait(&barrier);
+        w->start[t] = get_system_time();
+        run_kernel->run(w, n);
+        w->end[t] = get_system_time();
+    }
+    return NULL;
+}
+
+// Runs one kernel on the first nthreads workers and fills gbps[] per trial
+static void run_bandwidth(BwWorker *workers, int nthreads, const BwKernel *kernel, int trials, double *gbps) {
+    barrier.count = nthreads;
+    barrier.waiting = 0;
+    run_kernel = kernel;
+    run_trials = trials;
+    for (int w = 0; w < nthreads; w++) {
+        if (pthread_create(&workers[w].thread, NULL, bw_worker, &workers[w]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (int w = 0; w < nthreads; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+
+    // Bandwidth over the whole trial: first start to last finish
+    double bytes = (double)nthreads * (workers[0].array_bytes / sizeof(double)) * kernel->bytes;
+    for (int t = 0; t < trials; t++) {
+        uint64_t first_start = UINT64_MAX, last_end = 0;
+        for (int w = 0; w < nthreads; w++) {
+            if (workers[w].start[t] < first_start) first_start = workers[w].start[t];
+            if (workers[w].end[t] > last_end) last_end = workers[w].end[t];
+        }
+        double seconds = (double)(last_end - first_start) / (double)bench_clock_freq();
+        gbps[t] = seconds > 0 ? bytes / seconds / 1e9 : 0.0;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    int n = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_getaffinity");
+        exit(1);
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[n++] = cpu;
+        }
+    }
+    return n;
+}
+
+// Half of MemAvailable, so the arrays never push the machine into reclaim
+static size_t memory_limit() {
+    char line[256];
+    unsigned long long avail_kb = 0;
+    FILE *fp = fopen("/proc/meminfo", "r");
+
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp)) {
+            sscanf(line, "MemAvailable: %llu kB", &avail_kb);
+        }
+        fclose(fp);
+    }
+    return avail_kb > 0 ? (size_t)(avail_kb << 10) / 2 : (size_t)-1;
+}
+
+int main(int argc, char **argv) {
+    static double best[NUM_KERNELS][CPU_SETSIZE + 1];
+    int selected[NUM_KERNELS];
+    size_t array_mib = DEFAULT_ARRAY_MIB;
+    int trials = DEFAULT_TRIALS;
+    int max_threads = 0;
+    int every_count = FALSE;
+    int format = REPORT_TEXT;
+    const char *output = NULL, *environment = NULL;
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        selected[k] = TRUE;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            array_mib = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            trials = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            every_count = TRUE;
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            memset(selected, 0, sizeof(selected));
+            for (char *name = strtok(argv[++i], ","); name != NULL; name = strtok(NULL, ",")) {
+                int k = 0;
+                while (k < NUM_KERNELS && strcmp(name, kernels[k].name) != 0) k++;
+                if (k == NUM_KERNELS) {
+                    trials = 0;
+                    break;
+                }
+                selected[k] = TRUE;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            format = report_format_parse(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            environment = argv[++i];
+        } else {
+            trials = 0;
+            break;
+        }
+    }
+    if (trials <= 0 || trials > MAX_TRIALS || array_mib == 0 || max_threads < 0 || format < 0 ||
+        (output != NULL && format == REPORT_TEXT)) {
+        fprintf(stderr, "usage: %s [-s array_mib] [-n trials] [-w max_threads] [-a] [-k kernel,...]\n"
+                        "       [-f text|json|csv] [-o file, json/csv only] [-e environment]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror(output);
+        return 1;
+    }
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+
+    int *cpus = malloc(CPU_SETSIZE * sizeof(int));
+    int ncpus = allowed_cpus(cpus, CPU_SETSIZE);
+    if (max_threads == 0 || max_threads > ncpus) {
+        max_threads = ncpus;
+    }
+
+    // Three arrays per thread, all resident at once
+    size_t array_bytes = array_mib << 20;
+    if (array_bytes * 3 * max_threads > memory_limit()) {
+        array_bytes = memory_limit() / 3 / max_threads;
+        fprintf(stderr, "Arrays capped at %zu MiB per thread, half of MemAvailable\n", array_bytes >> 20);
+    }
+    array_bytes -= array_bytes % ((size_t)sysconf(_SC_PAGESIZE));
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0) {
+        llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+
+    BwWorker *workers = calloc(max_threads, sizeof(BwWorker));
+    for (int w = 0; w < max_threads; w++) {
+        workers[w].cpu = cpus[w];
+        workers[w].array_bytes = array_bytes;
+    }
+
+    Report report;
+    if (format == REPORT_TEXT) {
+        print_system_info("Memory Bandwidth Benchmark:\n");
+        printf("Kernels: %s, non-temporal stores: %s\n", SIMD_NAME,
+               HAVE_STREAM_STORES ? "yes" : "no (the _nt kernels use plain stores)");
+        printf("Arrays: 3 x %zu MiB per thread, %d trials (best shown, first skipped), CPUs available: %d\n",
+               array_bytes >> 20, trials, ncpus);
+        if (llc > 0 && array_bytes * 3 < (size_t)llc * 4) {
+            printf("Warning: one thread's arrays are under 4x the %ld MiB last-level cache; "
+                   "raise -s to keep cache hits out\n", llc >> 20);
+        }
+    } else {
+        report_begin(&report, out, format, "mem_bandwidth");
+        report_str(&report, "environment", environment != NULL ? environment : bench_environment());
+        report_str(&report, "simd", SIMD_NAME);
+        report_u64(&report, "stream_stores", HAVE_STREAM_STORES);
+        report_u64(&report, "array_bytes", array_bytes);
+        report_header_end(&report);
+    }
+
+    // 1, 2, 4, ... threads (every count with -a), always ending with all
+    double gbps[MAX_TRIALS];
+    int counts[CPU_SETSIZE], ncounts = 0;
+    for (int t = 1;; t = every_count ? t + 1 : t * 2 < max_threads ? t * 2 : max_threads) {
+        counts[ncounts++] = t;
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (!selected[k]) {
+                continue;
+            }
+            run_bandwidth(workers, t, &kernels[k], trials, gbps);
+
+            // The first trial faults in and warms up; STREAM leaves it out too
+            int first = trials > 1 ? 1 : 0;
+
+            // One row per trial, numbered like xbench repeats, so
+            // xbench_compare has every trial as a sample
+            for (int r = first; r < trials && format != REPORT_TEXT; r++) {
+                report_row_begin(&report);
+                report_str(&report, "command", "mem_bandwidth");
+                report_str(&report, "metric", kernels[k].name);
+                report_int(&report, "repeat", r - first);
+                report_u64(&report, "threads", t);
+                report_double(&report, "gbps", gbps[r]);
+                report_row_end(&report);
+            }
+            qsort(gbps + first, trials - first, sizeof(double), compare_doubles);
+            best[k][t] = gbps[trials - 1];
+        }
+        if (t >= max_threads) {
+            break;
+        }
+    }
+
+    if (format != REPORT_TEXT) {
+        report_end(&report);
+    } else {
+        printf("\nBest GB/s (10^9 bytes, STREAM counting: no write-allocate traffic)\n%-8s", "Threads");
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (selected[k]) printf(" %9s", kernels[k].name);
+        }
+        printf("\n");
+        for (int c = 0; c < ncounts; c++) {
+            printf("%-8d", counts[c]);
+            for (int k = 0; k < NUM_KERNELS; k++) {
+                if (selected[k]) printf(" %9.2f", best[k][counts[c]]);
+            }
+            printf("\n");
+        }
+
+        // Where each kernel stops scaling: the fewest threads within 10% of its peak
+        printf("\n");
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            if (!selected[k]) {
+                continue;
+            }
+            double peak = 0;
+            int peak_threads = 0, saturated = 0;
+            for (int c = 0; c < ncounts; c++) {
+                if (best[k][counts[c]] > peak) {
+                    peak = best[k][counts[c]];
+                    peak_threads = counts[c];
+                }
+            }
+            for (int c = 0; c < ncounts && saturated == 0; c++) {
+                if (best[k][counts[c]] >= peak * SATURATION) {
+                    saturated = counts[c];
+                }
+            }
+            printf("%-9s peak %8.2f GB/s at %d thread%s, %.0f%% of it from %d thread%s\n", kernels[k].name, peak,
+                   peak_threads, peak_threads == 1 ? "" : "s", SATURATION * 100, saturated,
+                   saturated == 1 ? "" : "s");
+        }
+    }
+
+    for (int w = 0; w < max_threads; w++) {
+        if (workers[w].a != NULL) {
+            munmap(workers[w].a, array_bytes);
+            munmap(workers[w].b, array_bytes);
+            munmap(workers[w].c, array_bytes);
+        }
+    }
+    free(workers);
+    free(cpus);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
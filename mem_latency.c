@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+#include "report.h"
+#include "stats.h"
+
+#define MIN_SIZE (4UL << 10)
+#define DEFAULT_MAX_MIB 4096
+#define DEFAULT_SAMPLES 200
+#define DEFAULT_POINTS 2
+#define MAX_SIZES 256
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define CHASE_HOPS 1024           // dependent loads per timed sample
+#define WARMUP_HOPS (4UL << 20)   // most loads spent warming a chain
+#define KNEE_STEP 1.25            // latency step between sizes flagged as a knee
+#define THP_ENABLED_PATH "/sys/kernel/mm/transparent_hugepage/enabled"
+
+enum {
+    PAGES_4K,             // MADV_NOHUGEPAGE: every page is a base page
+    PAGES_THP,            // MADV_HUGEPAGE on a 2 MiB aligned mapping
+    PAGES_HUGETLB,        // MAP_HUGETLB from the reserved pool
+    NUM_PAGE_MODES
+};
+
+static const char *page_mode_names[NUM_PAGE_MODES] = { "4k", "thp", "hugetlb" };
+
+typedef struct {
+    char *raw;
+    size_t raw_size;
+    char *mem;
+    unsigned long long huge_kb;   // AnonHugePages once populated
+} ChainBuffer;
+
+// The chain being walked; a global so the loads can't be optimised away
+static void **chase_pos;
+
+// CHASE_HOPS dependent loads, each to a random cache line
+static uint64_t chase_sample() {
+    void **p = chase_pos;
+    uint64_t start = get_system_time_start();
+    for (int i = 0; i < CHASE_HOPS; i += 8) {
+        p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+        p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+    }
+    uint64_t end = get_system_time_end();
+    chase_pos = p;
+    return bench_elapsed(start, end, TRUE);
+}
+
+// AnonHugePages from /proc/self/smaps_rollup, in KiB
+static unsigned long long read_huge_kb() {
+    char line[256];
+    unsigned long long huge_kb = 0;
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+
+    if (fp == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, "AnonHugePages: %llu kB", &huge_kb);
+    }
+    fclose(fp);
+    return huge_kb;
+}
+
+static int thp_available() {
+    char line[128];
+    FILE *fp = fopen(THP_ENABLED_PATH, "r");
+    if (fp == NULL) {
+        return FALSE;
+    }
+    int available = fgets(line, sizeof(line), fp) != NULL && strstr(line, "[never]") == NULL;
+    fclose(fp);
+    return available;
+}
+
+// Maps and touches size bytes with the page mode's backing. Returns -1
+// with the reason printed if the mode isn't available here.
+static int buffer_alloc(ChainBuffer *buf, int mode, size_t size) {
+    memset(buf, 0, sizeof(*buf));
+    if (mode == PAGES_THP && !thp_available()) {
+        fprintf(stderr, "thp: transparent huge pages are disabled (%s)\n", THP_ENABLED_PATH);
+        return -1;
+    }
+
+    if (mode == PAGES_HUGETLB) {
+        buf->raw_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        buf->raw = mmap(NULL, buf->raw_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buf->raw == MAP_FAILED) {
+            fprintf(stderr, "hugetlb: %s for %zu MiB (reserve pages in /proc/sys/vm/nr_hugepages)\n",
+                    strerror(errno), buf->raw_size >> 20);
+            return -1;
+        }
+        buf->mem = buf->raw;
+    } else {
+        // Aligned to a huge page so THP can back all of it
+        buf->raw_size = size + HUGE_PAGE_SIZE;
+        buf->raw = mmap(NULL, buf->raw_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf->raw == MAP_FAILED) {
+            fprintf(stderr, "%s: mmap of %zu MiB: %s\n", page_mode_names[mode], size >> 20, strerror(errno));
+            return -1;
+        }
+        buf->mem = (char *)(((uintptr_t)buf->raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        madvise(buf->mem, size, mode == PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        buf->mem[offset] = 1;
+    }
+    buf->huge_kb = read_huge_kb();
+    return 0;
+}
+
+static void buffer_free(ChainBuffer *buf) {
+    munmap(buf->raw, buf->raw_size);
+}
+
+// Links every line of the first size bytes into one random cycle (Sattolo's
+// algorithm), so each load depends on the last and no prefetcher can guess
+// the next line. The permutation is built in place, no side array needed.
+static void build_chain(char *mem, size_t size, size_t line, uint64_t *rng) {
+    size_t n = size / line;
+
+    for (size_t i = 0; i < n; i++) {
+        *(uintptr_t *)(mem + i * line) = i;
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = stat_rand(rng) % i;
+        uintptr_t *a = (uintptr_t *)(mem + i * line), *b = (uintptr_t *)(mem + j * line);
+        uintptr_t t = *a;
+        *a = *b;
+        *b = t;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t *slot = (uintptr_t *)(mem + i * line);
+        *slot = (uintptr_t)(mem + *slot * line);
+    }
+}
+
+static void format_size(size_t size, char *out, size_t len) {
+    if (size >= (1UL << 30)) {
+        snprintf(out, len, "%.4g GiB", (double)size / (1UL << 30));
+    } else if (size >= (1UL << 20)) {
+        snprintf(out, len, "%.4g MiB", (double)size / (1UL << 20));
+    } else {
+        snprintf(out, len, "%.4g KiB", (double)size / (1UL << 10));
+    }
+}
+
+// Half of MemAvailable, so the sweep never pushes the machine into reclaim
+static size_t memory_limit() {
+    char line[256];
+    unsigned long long avail_kb = 0;
+    FILE *fp = fopen("/proc/meminfo", "r");
+
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp)) {
+            sscanf(line, "MemAvailable: %llu kB", &avail_kb);
+        }
+        fclose(fp);
+    }
+    return avail_kb > 0 ? (size_t)(avail_kb << 10) / 2 : (size_t)-1;
+}
+
+static void print_caches() {
+    static const struct { const char *name; int conf; } caches[] = {
+        {"L1d", _SC_LEVEL1_DCACHE_SIZE},
+        {"L2", _SC_LEVEL2_CACHE_SIZE},
+        {"L3", _SC_LEVEL3_CACHE_SIZE},
+    };
+    char size[32];
+
+    printf("Caches:");
+    for (size_t c = 0; c < sizeof(caches) / sizeof(caches[0]); c++) {
+        long bytes = sysconf(caches[c].conf);
+        if (bytes > 0) {
+            format_size(bytes, size, sizeof(size));
+            printf(" %s %s", caches[c].name, size);
+        } else {
+            printf(" %s unknown", caches[c].name);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    static Histogram hist;
+    static double latency[NUM_PAGE_MODES][MAX_SIZES];
+    size_t sizes[MAX_SIZES];
+    int modes[NUM_PAGE_MODES] = { TRUE, TRUE, TRUE };
+    size_t max_mib = DEFAULT_MAX_MIB;
+    int samples = DEFAULT_SAMPLES, points = DEFAULT_POINTS;
+    int format = REPORT_TEXT;
+    const char *output = NULL, *environment = NULL;
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            max_mib = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            points = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            char *list = argv[++i];
+            memset(modes, 0, sizeof(modes));
+            for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+                int m = 0;
+                while (m < NUM_PAGE_MODES && strcmp(name, page_mode_names[m]) != 0) m++;
+                if (m == NUM_PAGE_MODES) {
+                    samples = 0;
+                    break;
+                }
+                modes[m] = TRUE;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            format = report_format_parse(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            environment = argv[++i];
+        } else {
+            samples = 0;
+            break;
+        }
+    }
+    if (samples <= 0 || points <= 0 || format < 0 || max_mib == 0 || (output != NULL && format == REPORT_TEXT)) {
+        fprintf(stderr, "usage: %s [-m max_mib] [-n samples] [-p points_per_doubling] [-P 4k,thp,hugetlb]\n"
+                        "       [-f text|json|csv] [-o file, json/csv only] [-e environment] [--cpu N] [--fifo PRIO] [--mlock]\n",
+                argv[0]);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror(output);
+        return 1;
+    }
+
+    // Pin and lock first so clock calibration runs under the same isolation
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+
+    size_t max_size = max_mib << 20;
+    if (max_size > memory_limit()) {
+        max_size = memory_limit();
+        fprintf(stderr, "Largest working set capped at %zu MiB, half of MemAvailable\n", max_size >> 20);
+    }
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (line < (long)sizeof(void *)) {
+        line = 64;
+    }
+
+    // points sizes per doubling from 4 KiB, whole cache lines
+    int nsizes = 0;
+    for (int k = 0; nsizes < MAX_SIZES; k++) {
+        size_t size = (size_t)((double)MIN_SIZE * exp2((double)k / points));
+        size -= size % line;
+        if (size > max_size) {
+            break;
+        }
+        if (nsizes == 0 || size != sizes[nsizes - 1]) {
+            sizes[nsizes++] = size;
+        }
+    }
+
+    Report report;
+    if (format == REPORT_TEXT) {
+        print_system_info("Memory Latency Benchmark:\n");
+        print_isolation(&iso_state);
+        print_caches();
+        printf("Random pointer chase over %ld-byte lines, %d samples of %d loads per size\n",
+               line, samples, CHASE_HOPS);
+    } else {
+        report_begin(&report, out, format, "mem_latency");
+        report_str(&report, "environment", environment != NULL ? environment : bench_environment());
+        report_int(&report, "pinned_cpu", iso_state.cpu);
+        report_u64(&report, "line_bytes", line);
+        report_header_end(&report);
+    }
+
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (int m = 0; m < NUM_PAGE_MODES; m++) {
+        ChainBuffer buf;
+        for (int s = 0; s < nsizes; s++) {
+            latency[m][s] = -1;
+        }
+        if (!modes[m] || buffer_alloc(&buf, m, sizes[nsizes - 1]) < 0) {
+            continue;
+        }
+        if (format == REPORT_TEXT) {
+            printf("%s: %llu MiB of %zu MiB in transparent huge pages\n", page_mode_names[m],
+                   buf.huge_kb >> 10, sizes[nsizes - 1] >> 20);
+        }
+
+        for (int s = 0; s < nsizes; s++) {
+            build_chain(buf.mem, sizes[s], line, &rng);
+            chase_pos = (void **)buf.mem;
+
+            // One pass over the chain, or WARMUP_HOPS, loads caches and TLBs
+            size_t warm = sizes[s] / line < WARMUP_HOPS ? sizes[s] / line : WARMUP_HOPS;
+            for (size_t hops = 0; hops < warm; hops += CHASE_HOPS) {
+                chase_sample();
+            }
+            WarmupResult warmup;
+            isolation_warmup(&iso_cfg, chase_sample, &warmup);
+
+            hist_init(&hist);
+            for (int i = 0; i < samples; i++) {
+                hist_record(&hist, chase_sample());
+            }
+            latency[m][s] = (double)hist_percentile(&hist, 50.0) * 1e9 / bench_clock_freq() / CHASE_HOPS;
+
+            if (format != REPORT_TEXT) {
+                report_row_begin(&report);
+                report_str(&report, "command", "mem_latency");
+                report_str(&report, "metric", page_mode_names[m]);
+                report_u64(&report, "size_bytes", sizes[s]);
+                report_u64(&report, "huge_kb", buf.huge_kb);
+                report_histogram(&report, &hist, CHASE_HOPS);
+                report_row_end(&report);
+            }
+        }
+        buffer_free(&buf);
+    }
+
+    if (format != REPORT_TEXT) {
+        report_end(&report);
+        if (out != stdout) {
+            fclose(out);
+        }
+        return 0;
+    }
+
+    // The curve: median ns per load for each page mode. The last column is
+    // what base pages cost over the best huge-page backing, i.e. the extra
+    // page walks; under a hypervisor these are two-stage walks.
+    printf("\n%-12s", "Size");
+    for (int m = 0; m < NUM_PAGE_MODES; m++) {
+        printf(" %10s ns", page_mode_names[m]);
+    }
+    printf(" %12s  %s\n", "walk ns", "knees");
+    for (int s = 0; s < nsizes; s++) {
+        char size[32];
+        double huge = -1;
+
+        format_size(sizes[s], size, sizeof(size));
+        printf("%-12s", size);
+        for (int m = 0; m < NUM_PAGE_MODES; m++) {
+            if (latency[m][s] < 0) {
+                printf(" %13s", "-");
+            } else {
+                printf(" %13.2f", latency[m][s]);
+            }
+            if (m != PAGES_4K && latency[m][s] >= 0 && (huge < 0 || latency[m][s] < huge)) {
+                huge = latency[m][s];
+            }
+        }
+        if (latency[PAGES_4K][s] >= 0 && huge >= 0) {
+            printf(" %+12.2f ", latency[PAGES_4K][s] - huge);
+        } else {
+            printf(" %12s ", "-");
+        }
+        // A knee is a step up from the previous size
+        for (int m = 0; m < NUM_PAGE_MODES && s > 0; m++) {
+            if (latency[m][s - 1] > 0 && latency[m][s] > latency[m][s - 1] * KNEE_STEP) {
+                printf(" %s +%.0f%%", page_mode_names[m], (latency[m][s] / latency[m][s - 1] - 1) * 100);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
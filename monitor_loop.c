@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "bench_core.h"
+#include "monitor_loop.h"
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct timespec ns_to_timespec(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    return ts;
+}
+
+static int watch(int epfd, int fd) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+uint64_t monitor_period_arg(const char *arg) {
+    uint64_t period_ns = strtoull(arg, NULL, 10) * 1000ULL;
+    return period_ns < MONITOR_MIN_PERIOD_NS ? MONITOR_MIN_PERIOD_NS : period_ns;
+}
+
+int monitor_loop_init(MonitorLoop *loop, uint64_t period_ns) {
+    sigset_t mask;
+
+    memset(loop, 0, sizeof(*loop));
+    loop->period_ns = period_ns < MONITOR_MIN_PERIOD_NS ? MONITOR_MIN_PERIOD_NS : period_ns;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        return -1;
+    }
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    loop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (loop->epfd < 0 || loop->sigfd < 0 || loop->timerfd < 0) {
+        return -1;
+    }
+
+    // Absolute first deadline with a fixed interval: the kernel keeps the
+    // schedule, so a late tick is followed by an on-time one
+    loop->deadline_ns = monotonic_ns();
+    struct itimerspec its = {
+        .it_interval = ns_to_timespec(loop->period_ns),
+        .it_value = ns_to_timespec(loop->deadline_ns + loop->period_ns),
+    };
+    if (timerfd_settime(loop->timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        return -1;
+    }
+
+    if (watch(loop->epfd, loop->timerfd) < 0 || watch(loop->epfd, loop->sigfd) < 0) {
+        return -1;
+    }
+    loop->stdin_open = watch(loop->epfd, STDIN_FILENO) == 0;
+    return 0;
+}
+
+int monitor_loop_wait(MonitorLoop *loop, MonitorEvent *event) {
+    struct epoll_event ready[3];
+
+    memset(event, 0, sizeof(*event));
+    for (;;) {
+        // Keys already read are handed out one per call
+        while (loop->key_pos < loop->nkeys) {
+            char c = loop->keys[loop->key_pos++];
+            if (c != '\n' && c != '\r') {
+                event->type = MONITOR_KEY;
+                event->key = c;
+                return 0;
+            }
+        }
+
+        int n = epoll_wait(loop->epfd, ready, 3, -1);
+        if (n < 0) {
+            return -1;
+        }
+
+        // Quit first, then the tick, then input, so a burst of keys can't
+        // delay a refresh
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.fd == loop->sigfd) {
+                struct signalfd_siginfo info;
+                if (read(loop->sigfd, &info, sizeof(info)) == sizeof(info)) {
+                    event->type = MONITOR_QUIT;
+                    return 0;
+                }
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.fd == loop->timerfd) {
+                uint64_t periods;
+                if (read(loop->timerfd, &periods, sizeof(periods)) == sizeof(periods) && periods > 0) {
+                    loop->deadline_ns += periods * loop->period_ns;
+                    loop->missed += periods - 1;
+                    event->type = MONITOR_TICK;
+                    event->periods = periods;
+                    event->interval_ns = periods * loop->period_ns;
+                    event->deadline_ns = loop->deadline_ns;
+                    return 0;
+                }
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.fd == STDIN_FILENO) {
+                ssize_t len = read(STDIN_FILENO, loop->keys, sizeof(loop->keys));
+                if (len <= 0) {
+                    // End of input: stop watching so epoll doesn't spin
+                    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+                    loop->stdin_open = FALSE;
+                    len = 0;
+                }
+                loop->nkeys = (int)len;
+                loop->key_pos = 0;
+            }
+        }
+    }
+}
+
+void monitor_loop_close(MonitorLoop *loop) {
+    close(loop->timerfd);
+    close(loop->sigfd);
+    close(loop->epfd);
+}
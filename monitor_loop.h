@@ -0,0 +1,57 @@
+#ifndef MONITOR_LOOP_H
+#define MONITOR_LOOP_H
+
+#include <stdint.h>
+
+// Event loop shared by the interrupt monitors: one epoll set watching a
+// periodic timerfd, stdin and a signalfd for SIGINT/SIGTERM.
+//
+// The timer runs on an absolute CLOCK_MONOTONIC schedule (first deadline
+// plus whole periods), so time spent processing a tick never pushes the
+// next one back and the schedule never drifts. Each tick reports how many
+// periods have passed since the previous one, which makes the interval an
+// exact multiple of the period instead of a measured sleep.
+#define MONITOR_MIN_PERIOD_NS 100000ULL
+#define MONITOR_DEFAULT_PERIOD_NS 100000000ULL
+
+enum {
+    MONITOR_TICK,
+    MONITOR_KEY,
+    MONITOR_QUIT
+};
+
+typedef struct {
+    int type;
+    int key;              // MONITOR_KEY: the character typed
+    uint64_t periods;     // MONITOR_TICK: periods since the previous tick;
+                          // more than 1 means ticks were missed
+    uint64_t interval_ns; // MONITOR_TICK: periods * period
+    uint64_t deadline_ns; // MONITOR_TICK: CLOCK_MONOTONIC deadline just met
+} MonitorEvent;
+
+typedef struct {
+    int epfd;
+    int timerfd;
+    int sigfd;
+    int stdin_open;
+    uint64_t period_ns;
+    uint64_t deadline_ns;
+    uint64_t missed;      // ticks that were merged into a later one
+    char keys[64];
+    int nkeys;
+    int key_pos;
+} MonitorLoop;
+
+// Blocks SIGINT and SIGTERM (they arrive through the signalfd instead) and
+// arms the timer one period from now. Returns -1 on failure.
+int monitor_loop_init(MonitorLoop *loop, uint64_t period_ns);
+
+// Waits for the next tick, key or quit signal. Returns -1 on error.
+int monitor_loop_wait(MonitorLoop *loop, MonitorEvent *event);
+
+void monitor_loop_close(MonitorLoop *loop);
+
+// Parses a period in microseconds, clamped to MONITOR_MIN_PERIOD_NS
+uint64_t monitor_period_arg(const char *arg);
+
+#endif
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "proc_interrupts.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+int proc_file_open(ProcFile *pf, const char *path, size_t size) {
+    pf->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pf->fd < 0) {
+        return -1;
+    }
+
+    pf->buf = malloc(size);
+    if (pf->buf == NULL) {
+        close(pf->fd);
+        pf->fd = -1;
+        return -1;
+    }
+    pf->size = size;
+
+    return 0;
+}
+
+ssize_t proc_file_read(ProcFile *pf) {
+    for (;;) {
+        size_t len = 0;
+
+        // seq_file regenerates the whole file for a read at offset 0, so one
+        // pread normally returns everything; keep reading only if it was split.
+        while (len < pf->size) {
+            ssize_t n = pread(pf->fd, pf->buf + len, pf->size - len, len);
+            if (n < 0) {
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            len += n;
+        }
+
+        if (len < pf->size) {
+            return len;
+        }
+
+        // A full buffer may have cut the file short: grow it and read the
+        // whole file again, so the snapshot stays consistent
+        char *buf = realloc(pf->buf, pf->size * 2);
+        if (buf == NULL) {
+            return -1;
+        }
+        pf->buf = buf;
+        pf->size *= 2;
+    }
+}
+
+void proc_file_close(ProcFile *pf) {
+    if (pf->fd >= 0) {
+        close(pf->fd);
+    }
+    free(pf->buf);
+    pf->fd = -1;
+    pf->buf = NULL;
+    pf->size = 0;
+}
+
+#define IRQ_KEY_OFFSET 0xcbf29ce484222325ULL
+#define IRQ_KEY_PRIME 0x100000001b3ULL
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// FNV-1a, so the parser can build the key while it scans the label
+uint64_t irq_key(const char *label, size_t len) {
+    uint64_t key = IRQ_KEY_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        key = (key ^ (unsigned char)label[i]) * IRQ_KEY_PRIME;
+    }
+    return key;
+}
+
+static uint32_t index_size(int max_rows) {
+    uint32_t size = 16;
+    while (size < (uint32_t)max_rows * 2) {
+        size <<= 1;
+    }
+    return size;
+}
+
+int irq_index_init(IrqIndex *index, int max_rows) {
+    uint32_t size = index_size(max_rows);
+
+    index->slots = calloc(size, sizeof(int32_t));
+    if (index->slots == NULL) {
+        return -1;
+    }
+    index->mask = size - 1;
+
+    return 0;
+}
+
+void irq_index_free(IrqIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->mask = 0;
+}
+
+void irq_index_clear(IrqIndex *index) {
+    memset(index->slots, 0, (index->mask + 1) * sizeof(int32_t));
+}
+
+void irq_index_insert(IrqIndex *index, uint64_t key, int row) {
+    uint32_t slot = (uint32_t)key & index->mask;
+    while (index->slots[slot] != 0) {
+        slot = (slot + 1) & index->mask;
+    }
+    index->slots[slot] = row + 1;
+}
+
+static inline int same_row(const InterruptInfo *a, const InterruptInfo *b) {
+    return a->key == b->key && strcmp(a->label, b->label) == 0;
+}
+
+int irq_index_find(const IrqIndex *index, const InterruptInfo *rows, int nrows,
+                   const InterruptInfo *info, int hint) {
+    if (hint >= 0 && hint < nrows && same_row(&rows[hint], info)) {
+        return hint;
+    }
+
+    uint32_t slot = (uint32_t)info->key & index->mask;
+    while (index->slots[slot] != 0) {
+        int row = index->slots[slot] - 1;
+        if (same_row(&rows[row], info)) {
+            return row;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+
+    return -1;
+}
+
+static inline size_t align_up(size_t n) {
+    return (n + 63) & ~(size_t)63;
+}
+
+// Lays out a fresh arena for the given capacities. The old contents are
+// dropped, so the caller parses again afterwards. On failure the snapshot
+// keeps its old arena.
+static int snapshot_reserve(InterruptSnapshot *snap, int max_irqs, int max_cpus, size_t strings_size) {
+    uint32_t slots = index_size(max_irqs);
+    size_t info_bytes = align_up((size_t)max_irqs * sizeof(InterruptInfo));
+    size_t counts_bytes = align_up((size_t)max_irqs * max_cpus * sizeof(uint32_t));
+    size_t index_bytes = align_up(slots * sizeof(int32_t));
+    size_t ids_bytes = align_up((size_t)max_cpus * sizeof(int));
+    size_t total = info_bytes + 2 * counts_bytes + index_bytes + ids_bytes + align_up(strings_size);
+
+    char *arena = aligned_alloc(64, total);
+    if (arena == NULL) {
+        return -1;
+    }
+    free(snap->arena);
+
+    snap->arena = arena;
+    snap->arena_size = total;
+    snap->max_irqs = max_irqs;
+    snap->max_cpus = max_cpus;
+    snap->info = (InterruptInfo *)arena;
+    snap->counts = (uint32_t *)(arena + info_bytes);
+    snap->delta = (uint32_t *)(arena + info_bytes + counts_bytes);
+    snap->index.slots = (int32_t *)(arena + info_bytes + 2 * counts_bytes);
+    snap->index.mask = slots - 1;
+    snap->cpu_ids = (int *)(arena + info_bytes + 2 * counts_bytes + index_bytes);
+    snap->strings = arena + info_bytes + 2 * counts_bytes + index_bytes + ids_bytes;
+    snap->strings_size = strings_size;
+    snap->nirqs = 0;
+    snap->ncpus = 0;
+
+    return 0;
+}
+
+int snapshot_init(InterruptSnapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    return snapshot_reserve(snap, SNAPSHOT_INITIAL_IRQS, SNAPSHOT_INITIAL_CPUS, SNAPSHOT_INITIAL_STRINGS);
+}
+
+void snapshot_free(InterruptSnapshot *snap) {
+    free(snap->arena);
+    memset(snap, 0, sizeof(*snap));
+}
+
+#define PARSE_RESTART -2
+
+static int parse_pass(const char *buf, size_t len, InterruptSnapshot *snap) {
+    const char *p = buf;
+    const char *end = buf + len;
+    size_t strings_used = 0;
+    int ncpus = 0;
+    int count = 0;
+
+    // The header names one column per CPU; rows never have more counts
+    const char *header = p;
+    while (p < end && *p != '\n') {
+        if (*p == 'C' && end - p >= 3 && p[1] == 'P' && p[2] == 'U') {
+            ncpus++;
+            p += 3;
+        } else {
+            p++;
+        }
+    }
+    const char *header_end = p++;
+
+    if (ncpus > snap->max_cpus &&
+        snapshot_reserve(snap, snap->max_irqs, ncpus, snap->strings_size) < 0) {
+        return -1;
+    }
+    snap->ncpus = ncpus;
+
+    // Second pass over the header for the CPU number above each column
+    int column = 0;
+    for (const char *h = header; h < header_end && column < ncpus;) {
+        if (*h == 'C' && header_end - h >= 3 && h[1] == 'P' && h[2] == 'U') {
+            int cpu = 0, digits = 0;
+            for (h += 3; h < header_end && is_digit(*h); h++, digits++) {
+                cpu = cpu * 10 + (*h - '0');
+            }
+            snap->cpu_ids[column] = digits > 0 ? cpu : column;
+            column++;
+        } else {
+            h++;
+        }
+    }
+    irq_index_clear(&snap->index);
+
+    size_t stride = snap->max_irqs;
+
+    while (p < end) {
+        if (count == snap->max_irqs) {
+            if (snapshot_reserve(snap, snap->max_irqs * 2, snap->max_cpus, snap->strings_size) < 0) {
+                return -1;
+            }
+            return PARSE_RESTART;
+        }
+
+        InterruptInfo *info = &snap->info[count];
+        uint32_t *counts = &snap->counts[count];
+
+        while (p < end && *p == ' ') p++;
+        const char *label = p;
+
+        // The label is the row's identity: a number, or a name such as NMI
+        // or IPI0, which get irq -1 and are told apart by their key
+        uint64_t key = IRQ_KEY_OFFSET;
+        int irq = 0;
+        int numeric = 1;
+        while (p < end && *p != ':' && *p != '\n') {
+            char c = *p++;
+            key = (key ^ (unsigned char)c) * IRQ_KEY_PRIME;
+            if (is_digit(c)) {
+                irq = irq * 10 + (c - '0');
+            } else {
+                numeric = 0;
+            }
+        }
+        if (p >= end) break;
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        const char *label_end = p++;
+
+        // Per-CPU counts, stopping at the first non-numeric token. Rows such
+        // as ERR only have one column; the missing CPUs read as zero.
+        unsigned long long total = 0;
+        int cpu;
+        for (cpu = 0; cpu < ncpus; cpu++) {
+            while (p < end && *p == ' ') p++;
+            const char *token = p;
+            uint32_t value = 0;
+            while (p < end && is_digit(*p)) {
+                value = value * 10 + (*p++ - '0');
+            }
+            if (p == token || (p < end && *p != ' ' && *p != '\n')) {
+                p = token;
+                break;
+            }
+            counts[cpu * stride] = value;
+            total += value;
+        }
+        for (; cpu < ncpus; cpu++) {
+            counts[cpu * stride] = 0;
+        }
+
+        // First word after the counts (the irq chip or the description),
+        // falling back to the row label for bare counters like ERR
+        while (p < end && *p == ' ') p++;
+        const char *name = p;
+        while (p < end && *p != ' ' && *p != '\n') p++;
+        const char *name_end = p;
+        if (name == name_end) {
+            name = label;
+            name_end = label_end;
+        }
+
+        // Drop a trailing line that was cut short
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) break;
+        p = eol + 1;
+
+        size_t label_len = label_end - label;
+        size_t name_len = name_end - name;
+        size_t needed = label_len + name_len + 2;
+        if (strings_used + needed > snap->strings_size) {
+            if (snapshot_reserve(snap, snap->max_irqs, snap->max_cpus,
+                                 snap->strings_size * 2 + needed) < 0) {
+                return -1;
+            }
+            return PARSE_RESTART;
+        }
+
+        char *strings = snap->strings + strings_used;
+        memcpy(strings, label, label_len);
+        strings[label_len] = '\0';
+        memcpy(strings + label_len + 1, name, name_len);
+        strings[label_len + 1 + name_len] = '\0';
+        strings_used += needed;
+
+        info->label = strings;
+        info->name = strings + label_len + 1;
+
+        info->irq = numeric && label_end > label ? irq : -1;
+        info->key = key;
+        info->count = total;
+        irq_index_insert(&snap->index, key, count);
+        count++;
+    }
+
+    snap->nirqs = count;
+    return count;
+}
+
+int parse_interrupts(const char *buf, size_t len, InterruptSnapshot *snap) {
+    int count;
+
+    do {
+        count = parse_pass(buf, len, snap);
+    } while (count == PARSE_RESTART);
+
+    if (count < 0) {
+        snap->nirqs = 0;
+    }
+    return count;
+}
+
+void read_interrupts(ProcFile *pf, InterruptSnapshot *snap) {
+    ssize_t len = proc_file_read(pf);
+    if (len < 0) {
+        perror("Failed to read /proc/interrupts");
+        exit(1);
+    }
+
+    if (parse_interrupts(pf->buf, len, snap) < 0) {
+        perror("Failed to grow interrupt tables");
+        exit(1);
+    }
+}
+
+int snapshot_cpu_column(const InterruptSnapshot *snap, int cpu) {
+    if (cpu >= 0 && cpu < snap->ncpus && snap->cpu_ids[cpu] == cpu) {
+        return cpu;
+    }
+
+    // The header lists CPUs in ascending order
+    int lo = 0, hi = snap->ncpus - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (snap->cpu_ids[mid] == cpu) {
+            return mid;
+        }
+        if (snap->cpu_ids[mid] < cpu) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+int snapshot_same_layout(const InterruptSnapshot *a, const InterruptSnapshot *b) {
+    if (a->nirqs != b->nirqs || a->ncpus != b->ncpus ||
+        memcmp(a->cpu_ids, b->cpu_ids, a->ncpus * sizeof(int)) != 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < a->nirqs; i++) {
+        if (!same_row(&a->info[i], &b->info[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void irq_delta_u32(const uint32_t *curr, const uint32_t *prev, uint32_t *delta, size_t n) {
+    size_t i = 0;
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8) {
+        uint32x4_t lo = vsubq_u32(vld1q_u32(curr + i), vld1q_u32(prev + i));
+        uint32x4_t hi = vsubq_u32(vld1q_u32(curr + i + 4), vld1q_u32(prev + i + 4));
+        vst1q_u32(delta + i, lo);
+        vst1q_u32(delta + i + 4, hi);
+    }
+#elif defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(curr + i));
+        __m256i p = _mm256_loadu_si256((const __m256i *)(prev + i));
+        _mm256_storeu_si256((__m256i *)(delta + i), _mm256_sub_epi32(c, p));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(curr + i));
+        __m128i p = _mm_loadu_si128((const __m128i *)(prev + i));
+        _mm_storeu_si128((__m128i *)(delta + i), _mm_sub_epi32(c, p));
+    }
+#endif
+
+    for (; i < n; i++) {
+        delta[i] = curr[i] - prev[i];
+    }
+}
+
+void snapshot_delta(InterruptSnapshot *curr, const InterruptSnapshot *prev) {
+    // The two snapshots may have grown to different strides
+    for (int cpu = 0; cpu < curr->ncpus; cpu++) {
+        size_t curr_offset = (size_t)cpu * curr->max_irqs;
+        size_t prev_offset = (size_t)cpu * prev->max_irqs;
+        irq_delta_u32(curr->counts + curr_offset, prev->counts + prev_offset,
+                      curr->delta + curr_offset, curr->nirqs);
+    }
+}
+
+void print_cpu_deltas(const InterruptSnapshot *snap, int row) {
+    if (snap->ncpus < 2) {
+        return;
+    }
+
+    printf("    Per-CPU:");
+    for (int column = 0; column < snap->ncpus; column++) {
+        uint32_t count = snapshot_cpu_delta(snap, column, row);
+        if (count > 0) {
+            printf(" CPU%d %u", snapshot_cpu_id(snap, column), count);
+        }
+    }
+    printf("\n");
+}
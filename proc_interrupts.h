@@ -0,0 +1,123 @@
+#ifndef PROC_INTERRUPTS_H
+#define PROC_INTERRUPTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Starting capacities; every table grows on demand
+#define PROC_FILE_BUF_SIZE (64 * 1024)
+#define SNAPSHOT_INITIAL_IRQS 256
+#define SNAPSHOT_INITIAL_CPUS 8
+#define SNAPSHOT_INITIAL_STRINGS (16 * 1024)
+
+typedef struct {
+    int irq;             // numeric IRQ, or -1 for symbolic rows (NMI, IPI0, Err...)
+    uint64_t key;        // hash of the full label; identifies the row
+    const char *label;   // row label as printed before the colon
+    const char *name;
+    unsigned long long count;
+} InterruptInfo;
+
+// Open-addressing hash index from a row's key to its position in the table
+typedef struct {
+    int32_t *slots;      // row + 1, 0 marks an empty slot
+    uint32_t mask;
+} IrqIndex;
+
+// One /proc/interrupts snapshot. Per-CPU counts are stored as a dense column
+// per CPU, counts[column * max_irqs + row], so the delta between two snapshots
+// with the same rows is a straight vector subtraction. The kernel prints
+// per-CPU counts as 32-bit values, so they are kept as uint32_t and wrap the
+// same way. Offline CPUs get no column, so a column is only the CPU number
+// while every CPU is online; cpu_ids holds the number from the header.
+//
+// All tables live in one arena owned by the snapshot. It only grows when a
+// refresh needs more rows, CPUs or string space than any refresh before, so
+// the steady state allocates nothing.
+typedef struct {
+    int nirqs;
+    int ncpus;
+    int max_irqs;        // row capacity, also the stride between CPU columns
+    int max_cpus;
+    int *cpu_ids;        // CPU number of each column
+    InterruptInfo *info;
+    uint32_t *counts;
+    uint32_t *delta;     // filled by snapshot_delta(), same layout as counts
+    char *strings;       // labels and names
+    size_t strings_size;
+    IrqIndex index;
+    void *arena;
+    size_t arena_size;
+} InterruptSnapshot;
+
+// A /proc file kept open between refreshes and read with pread() into a
+// buffer that is reused, so a snapshot costs one syscall. The buffer doubles
+// whenever a read fills it.
+typedef struct {
+    int fd;
+    char *buf;
+    size_t size;
+} ProcFile;
+
+int proc_file_open(ProcFile *pf, const char *path, size_t size);
+ssize_t proc_file_read(ProcFile *pf);
+void proc_file_close(ProcFile *pf);
+
+uint64_t irq_key(const char *label, size_t len);
+
+int irq_index_init(IrqIndex *index, int max_rows);
+void irq_index_free(IrqIndex *index);
+void irq_index_clear(IrqIndex *index);
+void irq_index_insert(IrqIndex *index, uint64_t key, int row);
+
+// Position of the row with the same label as info in rows[], or -1. The row
+// at hint is checked first, so while the row order is unchanged the lookup
+// never touches the hash slots.
+int irq_index_find(const IrqIndex *index, const InterruptInfo *rows, int nrows,
+                   const InterruptInfo *info, int hint);
+
+int snapshot_init(InterruptSnapshot *snap);
+void snapshot_free(InterruptSnapshot *snap);
+
+// Parses a /proc/interrupts snapshot in a single forward pass. Only complete
+// lines are parsed. If a table runs out of room it is grown and the pass
+// starts over. Returns the number of rows, or -1 if the arena can't grow.
+int parse_interrupts(const char *buf, size_t len, InterruptSnapshot *snap);
+
+void read_interrupts(ProcFile *pf, InterruptSnapshot *snap);
+
+static inline uint32_t *snapshot_cpu_counts(InterruptSnapshot *snap, int column) {
+    return &snap->counts[(size_t)column * snap->max_irqs];
+}
+
+static inline uint32_t snapshot_cpu_delta(const InterruptSnapshot *snap, int column, int row) {
+    return snap->delta[(size_t)column * snap->max_irqs + row];
+}
+
+static inline int snapshot_cpu_id(const InterruptSnapshot *snap, int column) {
+    return snap->cpu_ids[column];
+}
+
+// Column holding a CPU's counts, or -1 if the CPU is offline or unknown
+int snapshot_cpu_column(const InterruptSnapshot *snap, int cpu);
+
+static inline int snapshot_find_row(const InterruptSnapshot *snap, const InterruptInfo *info, int hint) {
+    return irq_index_find(&snap->index, snap->info, snap->nirqs, info, hint);
+}
+
+// True when both snapshots list the same rows in the same order for the
+// same CPUs, so their count matrices can be subtracted element by element.
+int snapshot_same_layout(const InterruptSnapshot *a, const InterruptSnapshot *b);
+
+// delta[i] = curr[i] - prev[i] modulo 2^32, vectorized where the ISA allows
+void irq_delta_u32(const uint32_t *curr, const uint32_t *prev, uint32_t *delta, size_t n);
+
+// Fills curr->delta with the per-CPU deltas for every row. Both snapshots
+// must have the same layout.
+void snapshot_delta(InterruptSnapshot *curr, const InterruptSnapshot *prev);
+
+// Prints the CPUs that took a row's interrupts, skipping idle CPUs
+void print_cpu_deltas(const InterruptSnapshot *snap, int row);
+
+#endif
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench_core.h"
+#include "proc_stat.h"
+
+#define PROC_SMALL_BUF_SIZE (16 * 1024)
+#define SOFTIRQ_MAX_COLUMNS 1024
+
+const char *cpu_time_names[CPU_TIME_FIELDS] = {
+    "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal", "guest", "guest_nice",
+};
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && *p == ' ') p++;
+    return p;
+}
+
+static const char *parse_u64(const char *p, const char *end, uint64_t *value) {
+    uint64_t v = 0;
+    p = skip_spaces(p, end);
+    while (p < end && is_digit(*p)) {
+        v = v * 10 + (*p++ - '0');
+    }
+    *value = v;
+    return p;
+}
+
+static const char *next_line(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p < end ? p + 1 : end;
+}
+
+int system_files_open(SystemFiles *files) {
+    memset(files, 0, sizeof(*files));
+    files->interrupts.fd = files->softirqs.fd = files->stat.fd = -1;
+    if (proc_file_open(&files->interrupts, "/proc/interrupts", PROC_FILE_BUF_SIZE) < 0 ||
+        proc_file_open(&files->softirqs, "/proc/softirqs", PROC_SMALL_BUF_SIZE) < 0 ||
+        proc_file_open(&files->stat, "/proc/stat", PROC_SMALL_BUF_SIZE) < 0) {
+        system_files_close(files);
+        return -1;
+    }
+    return 0;
+}
+
+void system_files_close(SystemFiles *files) {
+    proc_file_close(&files->interrupts);
+    proc_file_close(&files->softirqs);
+    proc_file_close(&files->stat);
+}
+
+static int reserve_cpus(SystemSnapshot *snap, int ncpus) {
+    if (ncpus <= snap->max_cpus) {
+        return 0;
+    }
+
+    int max_cpus = snap->max_cpus > 0 ? snap->max_cpus : SNAPSHOT_INITIAL_CPUS;
+    while (max_cpus < ncpus) {
+        max_cpus *= 2;
+    }
+    CpuActivity *cpus = realloc(snap->cpus, max_cpus * sizeof(CpuActivity));
+    if (cpus == NULL) {
+        return -1;
+    }
+    memset(cpus + snap->max_cpus, 0, (max_cpus - snap->max_cpus) * sizeof(CpuActivity));
+    snap->cpus = cpus;
+    snap->max_cpus = max_cpus;
+    return 0;
+}
+
+int system_snapshot_init(SystemSnapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    if (snapshot_init(&snap->irqs) < 0) {
+        return -1;
+    }
+    return reserve_cpus(snap, SNAPSHOT_INITIAL_CPUS);
+}
+
+void system_snapshot_free(SystemSnapshot *snap) {
+    snapshot_free(&snap->irqs);
+    free(snap->cpus);
+    snap->cpus = NULL;
+}
+
+int parse_softirqs(const char *buf, size_t len, SystemSnapshot *snap) {
+    const char *p = buf, *end = buf + len;
+    int columns[SOFTIRQ_MAX_COLUMNS];
+    int ncolumns = 0;
+
+    // Header: one CPUn per column, numbered because offline CPUs are skipped
+    while (p < end && *p != '\n') {
+        if (*p == 'C' && end - p > 3 && p[1] == 'P' && p[2] == 'U' && is_digit(p[3])) {
+            uint64_t cpu;
+            p = parse_u64(p + 3, end, &cpu);
+            if (ncolumns < SOFTIRQ_MAX_COLUMNS) {
+                columns[ncolumns++] = (int)cpu;
+                if (reserve_cpus(snap, cpu + 1) < 0) {
+                    return -1;
+                }
+                if ((int)cpu >= snap->ncpus) snap->ncpus = cpu + 1;
+            }
+        } else {
+            p++;
+        }
+    }
+    p = next_line(p, end);
+
+    memset(snap->total.softirq, 0, sizeof(snap->total.softirq));
+    snap->nsoftirqs = 0;
+    while (p < end && snap->nsoftirqs < SOFTIRQ_MAX) {
+        int row = snap->nsoftirqs;
+        p = skip_spaces(p, end);
+        const char *name = p;
+        while (p < end && *p != ':' && *p != '\n') p++;
+        if (p >= end || *p != ':') {
+            p = next_line(p, end);
+            continue;
+        }
+
+        size_t name_len = p - name < SOFTIRQ_NAME_LEN - 1 ? (size_t)(p - name) : SOFTIRQ_NAME_LEN - 1;
+        memcpy(snap->softirq_names[row], name, name_len);
+        snap->softirq_names[row][name_len] = '\0';
+        p++;
+
+        for (int c = 0; c < ncolumns; c++) {
+            uint64_t count;
+            p = skip_spaces(p, end);
+            if (p >= end || !is_digit(*p)) break;
+            p = parse_u64(p, end, &count);
+            snap->cpus[columns[c]].softirq[row] = (uint32_t)count;
+            snap->total.softirq[row] += (uint32_t)count;
+        }
+        p = next_line(p, end);
+        snap->nsoftirqs++;
+    }
+    return 0;
+}
+
+int parse_stat(const char *buf, size_t len, SystemSnapshot *snap) {
+    const char *p = buf, *end = buf + len;
+
+    for (int cpu = 0; cpu < snap->max_cpus; cpu++) {
+        snap->cpus[cpu].online = FALSE;
+    }
+    while (p < end) {
+        if (end - p > 3 && memcmp(p, "cpu", 3) == 0) {
+            CpuActivity *activity = &snap->total;
+            p += 3;
+            if (is_digit(*p)) {
+                uint64_t cpu;
+                p = parse_u64(p, end, &cpu);
+                if (reserve_cpus(snap, cpu + 1) < 0) {
+                    return -1;
+                }
+                if ((int)cpu >= snap->ncpus) snap->ncpus = cpu + 1;
+                activity = &snap->cpus[cpu];
+                activity->online = TRUE;
+            }
+            // Older kernels print fewer fields; the rest stay zero
+            for (int f = 0; f < CPU_TIME_FIELDS; f++) {
+                p = skip_spaces(p, end);
+                activity->time[f] = 0;
+                if (p < end && is_digit(*p)) {
+                    p = parse_u64(p, end, &activity->time[f]);
+                }
+            }
+        } else if (end - p > 5 && memcmp(p, "ctxt ", 5) == 0) {
+            p = parse_u64(p + 5, end, &snap->ctxt);
+        }
+        p = next_line(p, end);
+    }
+    return 0;
+}
+
+static const char *read_file(ProcFile *pf, const char *path, ssize_t *len) {
+    *len = proc_file_read(pf);
+    if (*len < 0) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        exit(1);
+    }
+    return pf->buf;
+}
+
+void read_system(SystemFiles *files, SystemSnapshot *snap) {
+    ssize_t irq_len, softirq_len, stat_len;
+
+    // All reads first, all parsing after, so the files are as close to one
+    // instant as three syscalls allow
+    uint64_t start = get_system_time();
+    const char *irq_buf = read_file(&files->interrupts, "/proc/interrupts", &irq_len);
+    const char *softirq_buf = read_file(&files->softirqs, "/proc/softirqs", &softirq_len);
+    const char *stat_buf = read_file(&files->stat, "/proc/stat", &stat_len);
+    uint64_t end = get_system_time();
+
+    snap->read_span = end - start;
+    snap->timestamp = start + snap->read_span / 2;
+    if (parse_interrupts(irq_buf, irq_len, &snap->irqs) < 0 ||
+        parse_softirqs(softirq_buf, softirq_len, snap) < 0 ||
+        parse_stat(stat_buf, stat_len, snap) < 0) {
+        perror("Failed to grow snapshot tables");
+        exit(1);
+    }
+}
+
+int system_cpu_rates(const SystemSnapshot *curr, const SystemSnapshot *prev, int cpu, CpuRates *rates) {
+    const CpuActivity *c, *p;
+
+    memset(rates, 0, sizeof(*rates));
+    if (cpu < 0) {
+        c = &curr->total;
+        p = &prev->total;
+    } else if (cpu < curr->ncpus && cpu < prev->ncpus && curr->cpus[cpu].online && prev->cpus[cpu].online) {
+        c = &curr->cpus[cpu];
+        p = &prev->cpus[cpu];
+    } else {
+        return -1;
+    }
+
+    rates->seconds = (double)(curr->timestamp - prev->timestamp) / (double)bench_clock_freq();
+    if (rates->seconds <= 0) {
+        return -1;
+    }
+
+    // guest time is already counted in user, so it's left out of the sum
+    uint64_t total = 0;
+    for (int f = 0; f < CPU_TIME_GUEST; f++) {
+        total += c->time[f] - p->time[f];
+    }
+    for (int f = 0; f < CPU_TIME_FIELDS && total > 0; f++) {
+        rates->time_pct[f] = 100.0 * (c->time[f] - p->time[f]) / total;
+    }
+
+    int nsoftirqs = curr->nsoftirqs < prev->nsoftirqs ? curr->nsoftirqs : prev->nsoftirqs;
+    for (int s = 0; s < nsoftirqs; s++) {
+        rates->softirqs_per_s[s] = (uint32_t)(c->softirq[s] - p->softirq[s]) / rates->seconds;
+    }
+
+    // Hard interrupts: this CPU's column of /proc/interrupts, or every row.
+    // The same layout means the same column in both snapshots.
+    rates->irqs_per_s = -1;
+    if (snapshot_same_layout(&curr->irqs, &prev->irqs)) {
+        // Summed from the per-column deltas: each CPU's counter wraps at
+        // 32 bits, so the difference of the row totals can underflow
+        int first = 0, last = curr->irqs.ncpus;
+        if (cpu >= 0) {
+            first = snapshot_cpu_column(&curr->irqs, cpu);
+            last = first >= 0 ? first + 1 : 0;
+        }
+        uint64_t irqs = 0;
+        for (int column = first; column < last; column++) {
+            for (int i = 0; i < curr->irqs.nirqs; i++) {
+                irqs += (uint32_t)(curr->irqs.counts[(size_t)column * curr->irqs.max_irqs + i] -
+                                   prev->irqs.counts[(size_t)column * prev->irqs.max_irqs + i]);
+            }
+        }
+        rates->irqs_per_s = irqs / rates->seconds;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef PROC_STAT_H
+#define PROC_STAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "proc_interrupts.h"
+
+// Combined /proc/interrupts, /proc/softirqs and /proc/stat snapshot. The
+// three files stay open and are read back to back, each with the single
+// pread of ProcFile, so together they cost three syscalls and describe the
+// same instant to within the read span. Softirq and CPU time rows are
+// parsed in place into fixed per-CPU records.
+#define SOFTIRQ_MAX 16
+#define SOFTIRQ_NAME_LEN 16
+
+// /proc/stat cpu line fields, in USER_HZ ticks
+enum {
+    CPU_TIME_USER,
+    CPU_TIME_NICE,
+    CPU_TIME_SYSTEM,
+    CPU_TIME_IDLE,
+    CPU_TIME_IOWAIT,
+    CPU_TIME_IRQ,
+    CPU_TIME_SOFTIRQ,
+    CPU_TIME_STEAL,
+    CPU_TIME_GUEST,
+    CPU_TIME_GUEST_NICE,
+    CPU_TIME_FIELDS
+};
+
+extern const char *cpu_time_names[CPU_TIME_FIELDS];
+
+typedef struct {
+    uint64_t time[CPU_TIME_FIELDS];
+    uint32_t softirq[SOFTIRQ_MAX];  // the kernel prints these as 32-bit values
+    int online;                     // has a cpuN line in /proc/stat
+} CpuActivity;
+
+typedef struct {
+    ProcFile interrupts;
+    ProcFile softirqs;
+    ProcFile stat;
+} SystemFiles;
+
+typedef struct {
+    uint64_t timestamp;   // clock ticks halfway through the three reads
+    uint64_t read_span;   // clock ticks from the first read to the last
+    InterruptSnapshot irqs;
+    int ncpus;            // highest CPU number seen plus one
+    int max_cpus;
+    CpuActivity *cpus;    // indexed by CPU number
+    CpuActivity total;    // the /proc/stat "cpu" line and softirq row sums
+    int nsoftirqs;
+    char softirq_names[SOFTIRQ_MAX][SOFTIRQ_NAME_LEN];
+    uint64_t ctxt;        // context switches since boot
+} SystemSnapshot;
+
+// Per-CPU rates between two snapshots
+typedef struct {
+    double seconds;
+    double irqs_per_s;                  // -1 if the interrupt rows changed
+    double time_pct[CPU_TIME_FIELDS];   // share of the CPU's accounted time
+    double softirqs_per_s[SOFTIRQ_MAX];
+} CpuRates;
+
+int system_files_open(SystemFiles *files);
+void system_files_close(SystemFiles *files);
+
+int system_snapshot_init(SystemSnapshot *snap);
+void system_snapshot_free(SystemSnapshot *snap);
+
+// Parsers for the two new files; each returns -1 if a table can't grow
+int parse_softirqs(const char *buf, size_t len, SystemSnapshot *snap);
+int parse_stat(const char *buf, size_t len, SystemSnapshot *snap);
+
+// Reads and parses all three files. Exits on failure, like read_interrupts().
+void read_system(SystemFiles *files, SystemSnapshot *snap);
+
+// Rates for one CPU, or for the whole system with cpu -1. Returns -1 if
+// the CPU isn't in both snapshots.
+int system_cpu_rates(const SystemSnapshot *curr, const SystemSnapshot *prev, int cpu, CpuRates *rates);
+
+#endif
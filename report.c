@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/utsname.h>
+
+#include "bench_core.h"
+#include "report.h"
+
+static const char *format_names[] = { "text", "json", "csv" };
+
+int report_format_parse(const char *name) {
+    for (int f = 0; f < (int)(sizeof(format_names) / sizeof(format_names[0])); f++) {
+        if (strcmp(name, format_names[f]) == 0) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// CSV fields are quoted only when they need it
+static void csv_field(FILE *out, const char *s) {
+    if (strpbrk(s, ",\"\n") == NULL) {
+        fputs(s, out);
+        return;
+    }
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        if (*s == '"') fputc('"', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+void report_begin(Report *r, FILE *out, int format, const char *command) {
+    char vendor[13] = {0}, brand[49] = {0};
+    struct utsname uts;
+
+    memset(r, 0, sizeof(*r));
+    r->out = out;
+    r->format = format;
+
+    cpu_write_vendor(vendor);
+    cpu_write_brand(brand);
+    if (uname(&uts) < 0) {
+        memset(&uts, 0, sizeof(uts));
+    }
+
+    // The system header is a row of its own, rendered per format
+    report_row_begin(r);
+    report_str(r, "command", command);
+    report_str(r, "kernel", uts.release);
+    report_str(r, "machine", uts.machine);
+    report_str(r, "cpu_vendor", vendor);
+    report_str(r, "cpu_brand", brand);
+    report_u64(r, "hypervisor", cpu_hv() ? 1 : 0);
+    report_str(r, "clock", bench_clock_name());
+    report_u64(r, "clock_hz", bench_clock_freq());
+    report_u64(r, "clock_overhead_ticks", bench_overhead[0].p50);
+    report_u64(r, "clock_overhead_serialized_ticks", bench_overhead[1].p50);
+}
+
+void report_header_end(Report *r) {
+    FILE *out = r->out;
+
+    if (r->format == REPORT_JSON) {
+        fprintf(out, "{\n  \"system\": {");
+        for (int f = 0; f < r->nfields; f++) {
+            fprintf(out, "%s\n    ", f > 0 ? "," : "");
+            json_string(out, r->names[f]);
+            fprintf(out, ": ");
+            if (r->quoted[f]) {
+                json_string(out, r->values[f]);
+            } else {
+                fputs(r->values[f], out);
+            }
+        }
+        fprintf(out, "\n  },\n  \"results\": [");
+    } else if (r->format == REPORT_CSV) {
+        for (int f = 0; f < r->nfields; f++) {
+            fprintf(out, "# %s: %s\n", r->names[f], r->values[f]);
+        }
+    } else {
+        for (int f = 0; f < r->nfields; f++) {
+            fprintf(out, "%s: %s\n", r->names[f], r->values[f]);
+        }
+        fprintf(out, "\n");
+    }
+    r->nfields = 0;
+}
+
+void report_end(Report *r) {
+    if (r->format == REPORT_JSON) {
+        fprintf(r->out, "%s]\n}\n", r->rows > 0 ? "\n  " : "");
+    }
+    fflush(r->out);
+}
+
+void report_row_begin(Report *r) {
+    r->nfields = 0;
+}
+
+static char *add_field(Report *r, const char *name, int quoted) {
+    if (r->nfields == REPORT_MAX_FIELDS) {
+        return NULL;
+    }
+    int f = r->nfields++;
+    snprintf(r->names[f], REPORT_FIELD_LEN, "%s", name);
+    r->quoted[f] = quoted;
+    return r->values[f];
+}
+
+void report_str(Report *r, const char *name, const char *value) {
+    char *v = add_field(r, name, TRUE);
+    if (v != NULL) {
+        snprintf(v, REPORT_FIELD_LEN, "%s", value);
+    }
+}
+
+void report_u64(Report *r, const char *name, uint64_t value) {
+    char *v = add_field(r, name, FALSE);
+    if (v != NULL) {
+        snprintf(v, REPORT_FIELD_LEN, "%llu", (unsigned long long)value);
+    }
+}
+
+void report_int(Report *r, const char *name, long long value) {
+    char *v = add_field(r, name, FALSE);
+    if (v != NULL) {
+        snprintf(v, REPORT_FIELD_LEN, "%lld", value);
+    }
+}
+
+void report_double(Report *r, const char *name, double value) {
+    char *v = add_field(r, name, FALSE);
+    if (v != NULL) {
+        snprintf(v, REPORT_FIELD_LEN, "%.3f", value);
+    }
+}
+
+// CSV needs a new header line whenever the column names change
+static void csv_header(Report *r) {
+    char header[sizeof(r->header)];
+    size_t len = 0;
+
+    for (int f = 0; f < r->nfields; f++) {
+        len += snprintf(header + len, sizeof(header) - len, "%s%s", f > 0 ? "," : "", r->names[f]);
+    }
+    if (r->header_fields == r->nfields && strcmp(header, r->header) == 0) {
+        return;
+    }
+    fprintf(r->out, "%s\n", header);
+    memcpy(r->header, header, len + 1);
+    r->header_fields = r->nfields;
+}
+
+void report_row_end(Report *r) {
+    FILE *out = r->out;
+
+    if (r->format == REPORT_JSON) {
+        fprintf(out, "%s\n    {", r->rows > 0 ? "," : "");
+        for (int f = 0; f < r->nfields; f++) {
+            fprintf(out, "%s", f > 0 ? ", " : "");
+            json_string(out, r->names[f]);
+            fprintf(out, ": ");
+            if (r->quoted[f]) {
+                json_string(out, r->values[f]);
+            } else {
+                fputs(r->values[f], out);
+            }
+        }
+        fprintf(out, "}");
+    } else if (r->format == REPORT_CSV) {
+        csv_header(r);
+        for (int f = 0; f < r->nfields; f++) {
+            if (f > 0) fputc(',', out);
+            csv_field(out, r->values[f]);
+        }
+        fputc('\n', out);
+    } else {
+        for (int f = 0; f < r->nfields; f++) {
+            fprintf(out, "%s%s=%s", f > 0 ? "  " : "", r->names[f], r->values[f]);
+        }
+        fputc('\n', out);
+    }
+    r->rows++;
+    r->nfields = 0;
+}
+
+void report_histogram(Report *r, const Histogram *h, int iterations) {
+    double scale = 1e9 / (double)bench_clock_freq() / (iterations > 0 ? iterations : 1);
+
+    report_u64(r, "samples", h->total);
+    report_u64(r, "iterations", iterations);
+    if (h->total == 0) {
+        return;
+    }
+    report_double(r, "min_ns", h->min * scale);
+    report_double(r, "p50_ns", hist_percentile(h, 50.0) * scale);
+    report_double(r, "p90_ns", hist_percentile(h, 90.0) * scale);
+    report_double(r, "p99_ns", hist_percentile(h, 99.0) * scale);
+    report_double(r, "p99_9_ns", hist_percentile(h, 99.9) * scale);
+    report_double(r, "max_ns", h->max * scale);
+    report_double(r, "mean_ns", hist_mean(h) * scale);
+    report_double(r, "stddev_ns", hist_stddev(h) * scale);
+}
@@ -0,0 +1,55 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+// Machine-readable results. A report is a system header followed by flat
+// rows of named fields. Text puts each row on one line as key=value pairs.
+// JSON writes one object with "system" and a "results" array. CSV writes
+// the system header as '#' comments and repeats the column header whenever
+// the row shape changes.
+enum {
+    REPORT_TEXT,
+    REPORT_JSON,
+    REPORT_CSV
+};
+
+#define REPORT_MAX_FIELDS 48
+#define REPORT_FIELD_LEN 128
+
+typedef struct {
+    FILE *out;
+    int format;
+    int rows;
+    int nfields;
+    char names[REPORT_MAX_FIELDS][REPORT_FIELD_LEN];
+    char values[REPORT_MAX_FIELDS][REPORT_FIELD_LEN];
+    int quoted[REPORT_MAX_FIELDS];
+    int header_fields;    // CSV: the shape the current header describes
+    char header[REPORT_MAX_FIELDS * REPORT_FIELD_LEN];
+} Report;
+
+// Returns -1 for an unknown format name (text, json, csv)
+int report_format_parse(const char *name);
+
+// Starts the system header with the clock, CPU and kernel the results came
+// from. The caller may add its own fields before report_header_end writes it.
+void report_begin(Report *r, FILE *out, int format, const char *command);
+void report_header_end(Report *r);
+void report_end(Report *r);
+
+void report_row_begin(Report *r);
+void report_str(Report *r, const char *name, const char *value);
+void report_u64(Report *r, const char *name, uint64_t value);
+void report_int(Report *r, const char *name, long long value);
+void report_double(Report *r, const char *name, double value);
+void report_row_end(Report *r);
+
+// Adds a histogram's count, percentiles, mean and stddev, converted from
+// ticks to nanoseconds and divided by iterations per sample
+void report_histogram(Report *r, const Histogram *h, int iterations);
+
+#endif
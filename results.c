@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench_core.h"
+#include "results.h"
+
+// Fields that name a measurement; "repeat" is left out so repeats line up
+static const char *key_fields[] = {
+    "command", "metric", "cpu", "irq", "name", "mode", "size_bytes", "threads",
+};
+
+static int add_field(ResultRow *row, const char *name, size_t name_len, const char *value, size_t value_len) {
+    if (row->nfields == row->max_fields) {
+        int max_fields = row->max_fields > 0 ? row->max_fields * 2 : 16;
+        ResultField *fields = realloc(row->fields, max_fields * sizeof(ResultField));
+        if (fields == NULL) {
+            return -1;
+        }
+        row->fields = fields;
+        row->max_fields = max_fields;
+    }
+    ResultField *f = &row->fields[row->nfields];
+    f->name = strndup(name, name_len);
+    f->value = strndup(value, value_len);
+    if (f->name == NULL || f->value == NULL) {
+        free(f->name);
+        free(f->value);
+        return -1;
+    }
+    row->nfields++;
+    return 0;
+}
+
+static void free_row(ResultRow *row) {
+    for (int f = 0; f < row->nfields; f++) {
+        free(row->fields[f].name);
+        free(row->fields[f].value);
+    }
+    free(row->fields);
+    memset(row, 0, sizeof(*row));
+}
+
+static ResultRow *add_row(ResultSet *set) {
+    if (set->nrows == set->max_rows) {
+        int max_rows = set->max_rows > 0 ? set->max_rows * 2 : 64;
+        ResultRow *rows = realloc(set->rows, max_rows * sizeof(ResultRow));
+        if (rows == NULL) {
+            return NULL;
+        }
+        set->rows = rows;
+        set->max_rows = max_rows;
+    }
+    ResultRow *row = &set->rows[set->nrows++];
+    memset(row, 0, sizeof(*row));
+    return row;
+}
+
+static const char *skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+// Copies the JSON string at p into out, unescaped and truncated to size.
+// Returns the position after the closing quote, or NULL if it never closes.
+static const char *json_string(const char *p, char *out, size_t size, size_t *len) {
+    size_t n = 0;
+
+    if (*p++ != '"') {
+        return NULL;
+    }
+    while (*p != '"') {
+        char c = *p++;
+        if (c == '\0') {
+            return NULL;
+        }
+        if (c == '\\') {
+            c = *p++;
+            if (c == 'n') {
+                c = '\n';
+            } else if (c == 't') {
+                c = '\t';
+            } else if (c == 'u') {
+                // report.c only escapes control characters this way
+                char hex[5] = {0};
+                for (int i = 0; i < 4 && p[i] != '\0'; i++) {
+                    hex[i] = p[i];
+                }
+                c = (char)strtol(hex, NULL, 16);
+                p += strlen(hex);
+            } else if (c == '\0') {
+                return NULL;
+            }
+        }
+        if (n + 1 < size) {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    *len = n;
+    return p + 1;
+}
+
+// One flat object of string and number values
+static const char *json_object(const char *p, ResultRow *row) {
+    char name[256], value[1024];
+    size_t name_len, value_len;
+
+    p = skip_space(p);
+    if (*p++ != '{') {
+        return NULL;
+    }
+    p = skip_space(p);
+    while (*p != '}') {
+        if ((p = json_string(p, name, sizeof(name), &name_len)) == NULL) {
+            return NULL;
+        }
+        p = skip_space(p);
+        if (*p++ != ':') {
+            return NULL;
+        }
+        p = skip_space(p);
+        if (*p == '"') {
+            p = json_string(p, value, sizeof(value), &value_len);
+            if (p == NULL) {
+                return NULL;
+            }
+        } else {
+            const char *start = p;
+            while (*p != '\0' && *p != ',' && *p != '}' && *p != ' ' && *p != '\n') p++;
+            value_len = (size_t)(p - start) < sizeof(value) - 1 ? (size_t)(p - start) : sizeof(value) - 1;
+            memcpy(value, start, value_len);
+            value[value_len] = '\0';
+        }
+        if (add_field(row, name, name_len, value, value_len) < 0) {
+            return NULL;
+        }
+        p = skip_space(p);
+        if (*p == ',') {
+            p = skip_space(p + 1);
+        } else if (*p != '}') {
+            return NULL;
+        }
+    }
+    return p + 1;
+}
+
+static int parse_json(const char *p, ResultSet *set) {
+    char name[64];
+    size_t name_len;
+
+    p = skip_space(p);
+    if (*p++ != '{') {
+        return -1;
+    }
+    for (;;) {
+        p = skip_space(p);
+        if (*p == '}') {
+            return 0;
+        }
+        if ((p = json_string(p, name, sizeof(name), &name_len)) == NULL) {
+            return -1;
+        }
+        p = skip_space(p);
+        if (*p++ != ':') {
+            return -1;
+        }
+        if (strcmp(name, "system") == 0) {
+            if ((p = json_object(p, &set->system)) == NULL) {
+                return -1;
+            }
+        } else if (strcmp(name, "results") == 0) {
+            p = skip_space(p);
+            if (*p++ != '[') {
+                return -1;
+            }
+            p = skip_space(p);
+            while (*p != ']') {
+                ResultRow *row = add_row(set);
+                if (row == NULL || (p = json_object(p, row)) == NULL) {
+                    return -1;
+                }
+                p = skip_space(p);
+                if (*p == ',') {
+                    p = skip_space(p + 1);
+                } else if (*p != ']') {
+                    return -1;
+                }
+            }
+            p++;
+        } else {
+            return -1;
+        }
+        p = skip_space(p);
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+// Splits one CSV line into fields, undoing report.c's quoting. Returns the
+// number of fields and points *next at the following line.
+static int csv_split(const char *p, char fields[][1024], int max, const char **next) {
+    int n = 0;
+
+    while (*p != '\0' && *p != '\n' && n < max) {
+        size_t len = 0;
+        if (*p == '"') {
+            p++;
+            while (*p != '\0' && !(*p == '"' && p[1] != '"')) {
+                if (*p == '"') p++;
+                if (len < 1023) fields[n][len++] = *p;
+                p++;
+            }
+            if (*p == '"') p++;
+        } else {
+            while (*p != '\0' && *p != ',' && *p != '\n' && *p != '\r') {
+                if (len < 1023) fields[n][len++] = *p;
+                p++;
+            }
+        }
+        fields[n++][len] = '\0';
+        if (*p == ',') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    while (*p != '\0' && *p != '\n') p++;
+    *next = *p == '\n' ? p + 1 : p;
+    return n;
+}
+
+#define CSV_MAX_FIELDS 64
+
+static int parse_csv(const char *p, ResultSet *set) {
+    static char header[CSV_MAX_FIELDS][1024];
+    static char fields[CSV_MAX_FIELDS][1024];
+    int nheader = 0;
+
+    while (*p != '\0') {
+        if (*p == '#') {
+            // "# name: value"
+            const char *name = skip_space(p + 1), *colon = strchr(name, ':');
+            const char *end = strchr(name, '\n');
+            if (end == NULL) end = name + strlen(name);
+            if (colon != NULL && colon < end) {
+                const char *value = colon + 1;
+                if (*value == ' ') value++;
+                if (add_field(&set->system, name, colon - name, value, end - value) < 0) {
+                    return -1;
+                }
+            }
+            p = *end == '\n' ? end + 1 : end;
+            continue;
+        }
+
+        const char *next;
+        int n = csv_split(p, fields, CSV_MAX_FIELDS, &next);
+        if (n > 0 && strcmp(fields[0], "command") == 0) {
+            memcpy(header, fields, sizeof(fields[0]) * n);
+            nheader = n;
+        } else if (n > 0) {
+            if (nheader == 0 || n != nheader) {
+                return -1;
+            }
+            ResultRow *row = add_row(set);
+            if (row == NULL) {
+                return -1;
+            }
+            for (int f = 0; f < n; f++) {
+                if (add_field(row, header[f], strlen(header[f]), fields[f], strlen(fields[f])) < 0) {
+                    return -1;
+                }
+            }
+        }
+        p = next;
+    }
+    return 0;
+}
+
+int results_load(const char *path, ResultSet *set) {
+    memset(set, 0, sizeof(*set));
+    set->path = path;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t size = 0, len = 0;
+    char *text = NULL;
+    for (;;) {
+        if (len + 4096 + 1 > size) {
+            size = size > 0 ? size * 2 : 65536;
+            char *grown = realloc(text, size);
+            if (grown == NULL) {
+                free(text);
+                fclose(f);
+                fprintf(stderr, "%s: out of memory\n", path);
+                return -1;
+            }
+            text = grown;
+        }
+        size_t n = fread(text + len, 1, size - len - 1, f);
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+    text[len] = '\0';
+    fclose(f);
+
+    const char *start = skip_space(text);
+    int rc = *start == '{' ? parse_json(start, set) : parse_csv(start, set);
+    free(text);
+    if (rc < 0) {
+        fprintf(stderr, "%s: not a JSON or CSV result file\n", path);
+        results_free(set);
+        return -1;
+    }
+    return 0;
+}
+
+void results_free(ResultSet *set) {
+    free_row(&set->system);
+    for (int r = 0; r < set->nrows; r++) {
+        free_row(&set->rows[r]);
+    }
+    free(set->rows);
+    set->rows = NULL;
+    set->nrows = set->max_rows = 0;
+}
+
+const char *result_get(const ResultRow *row, const char *name) {
+    for (int f = 0; f < row->nfields; f++) {
+        if (strcmp(row->fields[f].name, name) == 0) {
+            return row->fields[f].value;
+        }
+    }
+    return NULL;
+}
+
+int result_number(const ResultRow *row, const char *name, double *value) {
+    const char *text = result_get(row, name);
+    char *end;
+
+    if (text == NULL || *text == '\0') {
+        return -1;
+    }
+    *value = strtod(text, &end);
+    return *end == '\0' ? 0 : -1;
+}
+
+int result_is_key(const char *name) {
+    for (size_t k = 0; k < sizeof(key_fields) / sizeof(key_fields[0]); k++) {
+        if (strcmp(name, key_fields[k]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void result_key(const ResultRow *row, char *key, size_t size) {
+    size_t len = 0;
+
+    key[0] = '\0';
+    for (int f = 0; f < row->nfields && len < size; f++) {
+        if (result_is_key(row->fields[f].name)) {
+            len += snprintf(key + len, size - len, "%s%s=%s", len > 0 ? " " : "",
+                            row->fields[f].name, row->fields[f].value);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stddef.h>
+
+// Reader for the JSON and CSV files written by report.c. Only that layout
+// is understood: a JSON object with a flat "system" object and a "results"
+// array of flat objects, or CSV with '#' system lines and header lines that
+// start with "command". Every value is kept as the text that was written.
+typedef struct {
+    char *name;
+    char *value;
+} ResultField;
+
+typedef struct {
+    int nfields;
+    int max_fields;
+    ResultField *fields;
+} ResultRow;
+
+typedef struct {
+    const char *path;
+    ResultRow system;
+    int nrows;
+    int max_rows;
+    ResultRow *rows;
+} ResultSet;
+
+// Loads path, picking the format from its first character. Returns -1
+// with a message printed if it can't be read or parsed.
+int results_load(const char *path, ResultSet *set);
+void results_free(ResultSet *set);
+
+// Value of a field, or NULL if the row doesn't have it
+const char *result_get(const ResultRow *row, const char *name);
+
+// Parses a field as a number; returns -1 if it is missing or not a number
+int result_number(const ResultRow *row, const char *name, double *value);
+
+// TRUE for fields that say what was measured (command, metric, cpu, irq,
+// ...) rather than holding a measurement
+int result_is_key(const char *name);
+
+// The row's key fields joined as name=value, so rows for the same
+// measurement from different runs or repeats compare equal
+void result_key(const ResultRow *row, char *key, size_t size);
+
+#endif
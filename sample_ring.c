@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "bench_core.h"
+#include "sample_ring.h"
+
+#define REPORTER_POLL_US 1000
+
+SampleRing *sample_ring_create(uint32_t capacity, int shared) {
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    size_t map_size = sizeof(SampleRing) + (size_t)size * sizeof(SampleRecord);
+    SampleRing *ring = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                            (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+
+    // mmap hands back zeroed pages; touching them now keeps page faults
+    // out of the first pushes
+    memset(ring, 0, map_size);
+    ring->mask = size - 1;
+    ring->shared = shared;
+    ring->map_size = map_size;
+    return ring;
+}
+
+void sample_ring_destroy(SampleRing *ring) {
+    if (ring != NULL) {
+        munmap(ring, ring->map_size);
+    }
+}
+
+int sample_ring_drain(SampleRing *ring, SampleHandler handler, void *arg) {
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    for (; tail != head; tail++, n++) {
+        handler(&ring->records[tail & ring->mask], arg);
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+static int drain_all(SampleReporter *reporter) {
+    int n = 0;
+    for (int r = 0; r < reporter->nrings; r++) {
+        n += sample_ring_drain(reporter->rings[r], reporter->handler, reporter->arg);
+    }
+    return n;
+}
+
+static void *reporter_main(void *arg) {
+    SampleReporter *reporter = arg;
+    struct sched_param param = { .sched_priority = 0 };
+
+    // Best effort: a reporter at normal priority still works
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    if (reporter->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reporter->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while (!__atomic_load_n(&reporter->stop, __ATOMIC_ACQUIRE)) {
+        if (drain_all(reporter) == 0) {
+            usleep(REPORTER_POLL_US);
+        }
+    }
+    drain_all(reporter);
+    fflush(stdout);
+    return NULL;
+}
+
+// First allowed CPU that isn't the one the caller is measuring on
+static int other_cpu() {
+    cpu_set_t set;
+    int current = sched_getcpu();
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set) && cpu != current) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+int sample_reporter_start(SampleReporter *reporter, SampleRing **rings, int nrings,
+                          SampleHandler handler, void *arg, int cpu) {
+    reporter->rings = rings;
+    reporter->nrings = nrings;
+    reporter->handler = handler;
+    reporter->arg = arg;
+    reporter->cpu = cpu >= 0 ? cpu : other_cpu();
+    reporter->stop = FALSE;
+
+    int err = pthread_create(&reporter->thread, NULL, reporter_main, reporter);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+void sample_reporter_stop(SampleReporter *reporter) {
+    __atomic_store_n(&reporter->stop, TRUE, __ATOMIC_RELEASE);
+    pthread_join(reporter->thread, NULL);
+}
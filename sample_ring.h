@@ -0,0 +1,80 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Fixed-size binary sample, pushed from the measuring thread instead of
+// formatting output there
+typedef struct {
+    uint64_t timestamp;   // clock ticks when the sample was taken
+    uint64_t value;       // measured ticks
+    uint32_t source;      // producer-defined: worker, test number, ...
+    uint32_t kind;        // producer-defined: which measurement this is
+} SampleRecord;
+
+// Single-producer/single-consumer lock-free ring. head is only written by
+// the producer and tail only by the consumer; each sits on its own cache
+// line, and the producer keeps a private copy of tail so a push touches
+// the consumer's line only when the ring looks full. With shared set the
+// ring lives in MAP_SHARED memory, so a forked child can be the producer.
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t cached_tail;
+    uint64_t dropped;
+    uint64_t tail __attribute__((aligned(64)));
+    uint32_t mask;
+    int shared;
+    size_t map_size;
+    SampleRecord records[] __attribute__((aligned(64)));
+} SampleRing;
+
+// capacity is rounded up to a power of two. Returns NULL on failure.
+SampleRing *sample_ring_create(uint32_t capacity, int shared);
+void sample_ring_destroy(SampleRing *ring);
+
+// Producer side. Never blocks: when the ring is full the sample is counted
+// in dropped and 0 is returned.
+static inline int sample_ring_push(SampleRing *ring, const SampleRecord *rec) {
+    uint64_t head = ring->head;
+
+    if (head - ring->cached_tail > ring->mask) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head - ring->cached_tail > ring->mask) {
+            ring->dropped++;
+            return 0;
+        }
+    }
+
+    ring->records[head & ring->mask] = *rec;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Consumer side: hands every queued record to handler and returns how many
+typedef void (*SampleHandler)(const SampleRecord *rec, void *arg);
+int sample_ring_drain(SampleRing *ring, SampleHandler handler, void *arg);
+
+// Low-priority thread that drains a set of rings and passes each record
+// to handler, which aggregates and formats off the measuring CPU
+typedef struct {
+    pthread_t thread;
+    SampleRing **rings;
+    int nrings;
+    SampleHandler handler;
+    void *arg;
+    int cpu;
+    volatile int stop;
+} SampleReporter;
+
+// Starts the reporter under SCHED_IDLE, pinned to cpu or, with cpu < 0,
+// to any allowed CPU other than the caller's
+int sample_reporter_start(SampleReporter *reporter, SampleRing **rings, int nrings,
+                          SampleHandler handler, void *arg, int cpu);
+
+// Stops the reporter after a final drain, so every pushed record has been
+// handled when this returns
+void sample_reporter_stop(SampleReporter *reporter);
+
+#endif
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+
+#define DEFAULT_ITERATIONS 100
+#define MIN_RSS_MIB 1
+#define MAX_RSS_MIB 1024
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define CLONE_STACK_SIZE (64 * 1024)
+#define THP_ENABLED_PATH "/sys/kernel/mm/transparent_hugepage/enabled"
+
+extern char **environ;
+
+typedef struct {
+    const char *name;
+    uint64_t (*run)();
+} SpawnMethod;
+
+static const char *exec_path = "./spawn_true";
+static char *exec_argv[] = {"spawn_true", NULL};
+static char clone_stack[CLONE_STACK_SIZE] __attribute__((aligned(16)));
+
+// Every child must exit cleanly, or an exec that failed would be timed as a
+// very cheap spawn
+static void check_child(pid_t pid, const char *method) {
+    int status;
+
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        exit(1);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: child exited with status 0x%x (is %s built?)\n", method, status, exec_path);
+        exit(1);
+    }
+}
+
+static uint64_t spawn_fork() {
+    uint64_t start, end;
+    int status;
+
+    start = get_system_time();
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(0);
+    } else if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    waitpid(pid, &status, 0);
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static uint64_t spawn_vfork() {
+    uint64_t start, end;
+    int status;
+
+    start = get_system_time();
+    pid_t pid = vfork();
+    if (pid == 0) {
+        _exit(0);
+    } else if (pid < 0) {
+        perror("vfork");
+        exit(1);
+    }
+    waitpid(pid, &status, 0);
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static int clone_child(void *arg) {
+    return 0;
+}
+
+static uint64_t spawn_clone_vm() {
+    uint64_t start, end;
+    int status;
+
+    start = get_system_time();
+    pid_t pid = clone(clone_child, clone_stack + CLONE_STACK_SIZE, CLONE_VM | SIGCHLD, NULL);
+    if (pid < 0) {
+        perror("clone");
+        exit(1);
+    }
+    waitpid(pid, &status, 0);
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static uint64_t spawn_posix_spawn() {
+    uint64_t start, end;
+    pid_t pid;
+
+    start = get_system_time();
+    int err = posix_spawn(&pid, exec_path, NULL, NULL, exec_argv, environ);
+    if (err != 0) {
+        fprintf(stderr, "posix_spawn %s: %s\n", exec_path, strerror(err));
+        exit(1);
+    }
+    check_child(pid, "posix_spawn");
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static uint64_t spawn_fork_exec() {
+    uint64_t start, end;
+
+    start = get_system_time();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(exec_path, exec_argv, environ);
+        _exit(127);
+    } else if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    check_child(pid, "fork+exec");
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static void *thread_child(void *arg) {
+    return NULL;
+}
+
+static uint64_t spawn_pthread() {
+    uint64_t start, end;
+    pthread_t thread;
+
+    start = get_system_time();
+    int err = pthread_create(&thread, NULL, thread_child, NULL);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(1);
+    }
+    pthread_join(thread, NULL);
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static const SpawnMethod methods[] = {
+    {"fork", spawn_fork},
+    {"vfork", spawn_vfork},
+    {"clone(CLONE_VM)", spawn_clone_vm},
+    {"posix_spawn", spawn_posix_spawn},
+    {"fork+exec", spawn_fork_exec},
+    {"pthread_create", spawn_pthread},
+};
+
+#define NUM_METHODS (int)(sizeof(methods) / sizeof(methods[0]))
+
+// Maps and touches size bytes so the parent really has that much resident
+// memory to copy page tables for. The mapping is aligned to a huge page so
+// THP can back all of it.
+static char *grow_rss(size_t size, int thp, char **raw, size_t *raw_size) {
+    *raw_size = size + HUGE_PAGE_SIZE;
+    *raw = mmap(NULL, *raw_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (*raw == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    char *mem = (char *)(((uintptr_t)*raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    madvise(mem, size, thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < size; off += page_size) {
+        mem[off] = 1;
+    }
+    return mem;
+}
+
+// Rss and AnonHugePages from /proc/self/smaps_rollup, in KiB
+static void read_rss(unsigned long long *rss_kb, unsigned long long *huge_kb) {
+    char line[256];
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+
+    *rss_kb = 0;
+    *huge_kb = 0;
+    if (fp == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, "Rss: %llu kB", rss_kb);
+        sscanf(line, "AnonHugePages: %llu kB", huge_kb);
+    }
+    fclose(fp);
+}
+
+static int thp_available() {
+    char line[128];
+    FILE *fp = fopen(THP_ENABLED_PATH, "r");
+    if (fp == NULL) {
+        return FALSE;
+    }
+
+    int available = fgets(line, sizeof(line), fp) != NULL && strstr(line, "[never]") == NULL;
+    fclose(fp);
+    printf("Transparent huge pages: %s", available ? line : "unavailable\n");
+    return available;
+}
+
+static double ticks_to_us(uint64_t ticks) {
+    return ticks_to_ms(ticks) * 1000.0;
+}
+
+static void run_size(Histogram *hist, const IsolationConfig *iso_cfg, size_t rss_mib, int thp, int iterations,
+                     int verbose, int dump_buckets) {
+    char *raw;
+    size_t raw_size;
+    unsigned long long rss_kb, huge_kb;
+    char title[128];
+    WarmupResult warmup;
+
+    grow_rss(rss_mib << 20, thp, &raw, &raw_size);
+    read_rss(&rss_kb, &huge_kb);
+
+    printf("\nParent RSS %zu MiB, THP %s (Rss %llu MiB, AnonHugePages %llu MiB)\n",
+           rss_mib, thp ? "on" : "off", rss_kb >> 10, huge_kb >> 10);
+    // Warm-ups go before the table so they don't split its rows
+    for (int m = 0; m < NUM_METHODS && iso_cfg->warmup_samples > 0; m++) {
+        isolation_warmup(iso_cfg, methods[m].run, &warmup);
+        snprintf(title, sizeof(title), "  %s", methods[m].name);
+        print_warmup(title, &warmup);
+    }
+    printf("  %-16s %12s %12s %12s %12s %12s\n", "Method", "p50 (us)", "p90 (us)", "p99 (us)", "Max (us)", "Mean (us)");
+
+    for (int m = 0; m < NUM_METHODS; m++) {
+        hist_init(hist);
+        // One untimed run faults in the code and data the method touches
+        methods[m].run();
+        for (int i = 0; i < iterations; i++) {
+            hist_record(hist, methods[m].run());
+        }
+
+        printf("  %-16s %12.2f %12.2f %12.2f %12.2f %12.2f\n", methods[m].name,
+               ticks_to_us(hist_percentile(hist, 50.0)), ticks_to_us(hist_percentile(hist, 90.0)),
+               ticks_to_us(hist_percentile(hist, 99.0)), ticks_to_us(hist->max),
+               ticks_to_ms(hist_mean(hist)) * 1000.0);
+
+        if (verbose) {
+            snprintf(title, sizeof(title), "  %s, RSS %zu MiB, THP %s", methods[m].name, rss_mib, thp ? "on" : "off");
+            print_histogram(hist, title, 1);
+        }
+        if (dump_buckets) {
+            print_histogram_buckets(hist);
+        }
+    }
+
+    munmap(raw, raw_size);
+}
+
+int main(int argc, char **argv) {
+    static Histogram hist;
+    int iterations = DEFAULT_ITERATIONS;
+    size_t max_rss_mib = MAX_RSS_MIB;
+    int verbose = FALSE;
+    int dump_buckets = FALSE;
+    IsolationConfig iso_cfg;
+    IsolationState iso_state;
+
+    isolation_config_init(&iso_cfg);
+    for (int i = 1; i < argc; i++) {
+        if (isolation_parse_arg(&iso_cfg, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            max_rss_mib = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            exec_path = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = TRUE;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        } else {
+            iterations = 0;
+            break;
+        }
+    }
+    if (iterations <= 0 || max_rss_mib < MIN_RSS_MIB) {
+        fprintf(stderr, "usage: %s [-n iterations] [-m max_rss_mib] [-e exec_target] [-v] [-b]\n"
+                        "       [--cpu N] [--fifo PRIO] [--mlock] [--warmup N]\n", argv[0]);
+        return 1;
+    }
+
+    // Children inherit the affinity and scheduling class
+    isolation_apply(&iso_cfg, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+
+    print_system_info("Process Creation Benchmark:\n");
+    print_isolation(&iso_state);
+    printf("Iterations: %d per method and size, exec target: %s\n", iterations, exec_path);
+    int thp = thp_available();
+
+    for (int huge = 0; huge <= thp; huge++) {
+        for (size_t rss_mib = MIN_RSS_MIB; rss_mib <= max_rss_mib; rss_mib *= 4) {
+            run_size(&hist, &iso_cfg, rss_mib, huge, iterations, verbose, dump_buckets);
+        }
+    }
+
+    return 0;
+}
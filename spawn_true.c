@@ -0,0 +1,13 @@
+// Exec target for spawn_bench: no libc and no dynamic loader, so an exec
+// costs only the kernel's own work. Build with -static -nostdlib.
+void _start(void) {
+#if defined(__aarch64__)
+    asm volatile("mov x0, #0\n\tmov x8, #93\n\tsvc #0" : : : "x0", "x8", "memory");
+#elif defined(__x86_64__)
+    asm volatile("xor %%edi, %%edi\n\tmov $60, %%eax\n\tsyscall" : : : "rdi", "rax", "rcx", "r11", "memory");
+#else
+#error "spawn_true needs an AArch64 or x86_64 target"
+#endif
+    for (;;) {
+    }
+}
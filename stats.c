@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench_core.h"
+#include "stats.h"
+
+void stat_init(RunningStat *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void stat_add(RunningStat *s, double x) {
+    double d = x - s->mean;
+    s->n++;
+    s->mean += d / s->n;
+    s->m2 += d * (x - s->mean);
+}
+
+double stat_stddev(const RunningStat *s) {
+    return s->n > 1 ? sqrt(s->m2 / (s->n - 1)) : 0.0;
+}
+
+double stat_stderr(const RunningStat *s) {
+    return s->n > 1 ? stat_stddev(s) / sqrt((double)s->n) : 0.0;
+}
+
+double t_critical95(uint64_t df) {
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if (df == 0) {
+        return INFINITY;
+    }
+    if (df < sizeof(table) / sizeof(table[0])) {
+        return table[df];
+    }
+    // Past 30 the t distribution is close enough to normal
+    return df < 60 ? 2.000 : df < 120 ? 1.980 : 1.960;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double sorted_quantile(const double *sorted, int n, double q) {
+    if (n == 0) {
+        return NAN;
+    }
+    double pos = q * (n - 1);
+    int i = (int)pos;
+    if (i >= n - 1) {
+        return sorted[n - 1];
+    }
+    return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+double sample_quantile(const double *x, int n, double q) {
+    double *sorted = malloc(n * sizeof(double));
+    if (sorted == NULL) {
+        return NAN;
+    }
+    memcpy(sorted, x, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    double value = sorted_quantile(sorted, n, q);
+    free(sorted);
+    return value;
+}
+
+static double resample_quantile(const double *x, int n, double q, uint64_t *rng, double *scratch) {
+    for (int i = 0; i < n; i++) {
+        scratch[i] = x[stat_rand(rng) % n];
+    }
+    qsort(scratch, n, sizeof(double), compare_doubles);
+    return sorted_quantile(scratch, n, q);
+}
+
+// Shared by both intervals: y == NULL bootstraps quantile(x) alone
+static void bootstrap_ci(const double *x, int nx, const double *y, int ny, double q,
+                         int resamples, uint64_t *rng, double *lo, double *hi) {
+    double *scratch = malloc((nx > ny ? nx : ny) * sizeof(double));
+    double *estimates = malloc(resamples * sizeof(double));
+    int n = 0;
+
+    *lo = *hi = NAN;
+    if (scratch == NULL || estimates == NULL || nx == 0 || (y != NULL && ny == 0)) {
+        free(scratch);
+        free(estimates);
+        return;
+    }
+    for (int r = 0; r < resamples; r++) {
+        double qx = resample_quantile(x, nx, q, rng, scratch);
+        if (y == NULL) {
+            estimates[n++] = qx;
+        } else if (qx != 0) {
+            estimates[n++] = resample_quantile(y, ny, q, rng, scratch) / qx;
+        }
+    }
+    if (n > 0) {
+        qsort(estimates, n, sizeof(double), compare_doubles);
+        *lo = sorted_quantile(estimates, n, 0.025);
+        *hi = sorted_quantile(estimates, n, 0.975);
+    }
+    free(scratch);
+    free(estimates);
+}
+
+void bootstrap_ratio_ci(const double *x, int nx, const double *y, int ny, double q,
+                        int resamples, uint64_t *rng, double *lo, double *hi) {
+    bootstrap_ci(x, nx, y, ny, q, resamples, rng, lo, hi);
+}
+
+void bootstrap_quantile_ci(const double *x, int n, double q, int resamples, uint64_t *rng,
+                           double *lo, double *hi) {
+    bootstrap_ci(x, n, NULL, 0, q, resamples, rng, lo, hi);
+}
+
+typedef struct {
+    double value;
+    int group;
+} RankedValue;
+
+static int compare_ranked(const void *a, const void *b) {
+    return compare_doubles(&((const RankedValue *)a)->value, &((const RankedValue *)b)->value);
+}
+
+double mann_whitney(const double *x, int nx, const double *y, int ny, double *u) {
+    int n = nx + ny;
+    RankedValue *all = malloc(n * sizeof(RankedValue));
+
+    *u = NAN;
+    if (all == NULL || nx == 0 || ny == 0) {
+        free(all);
+        return NAN;
+    }
+    for (int i = 0; i < nx; i++) {
+        all[i] = (RankedValue){x[i], 0};
+    }
+    for (int i = 0; i < ny; i++) {
+        all[nx + i] = (RankedValue){y[i], 1};
+    }
+    qsort(all, n, sizeof(RankedValue), compare_ranked);
+
+    // Tied values share the mean of their ranks
+    double rank_sum = 0, ties = 0;
+    for (int i = 0; i < n;) {
+        int j = i;
+        while (j < n && all[j].value == all[i].value) j++;
+        double rank = (i + 1 + j) / 2.0;
+        for (int k = i; k < j; k++) {
+            if (all[k].group == 0) rank_sum += rank;
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    free(all);
+
+    *u = rank_sum - (double)nx * (nx + 1) / 2;
+    double mean = (double)nx * ny / 2;
+    double var = (double)nx * ny / 12 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0) {
+        return 1.0;
+    }
+    double z = (fabs(*u - mean) - 0.5) / sqrt(var);
+    if (z < 0) {
+        z = 0;
+    }
+    return erfc(z / sqrt(2.0));
+}
@@ -0,0 +1,53 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Running mean and variance (Welford), for quantities that are not clock
+// ticks and so don't belong in a Histogram: rates, ratios, per-op counts
+typedef struct {
+    uint64_t n;
+    double mean;
+    double m2;            // sum of squared distances from the mean
+} RunningStat;
+
+void stat_init(RunningStat *s);
+void stat_add(RunningStat *s, double x);
+double stat_stddev(const RunningStat *s);
+
+// Standard error of the mean
+double stat_stderr(const RunningStat *s);
+
+// Two-sided 95% Student t critical value for df degrees of freedom
+double t_critical95(uint64_t df);
+
+// xorshift64* generator for resampling; the state must start nonzero
+static inline uint64_t stat_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// q-quantile (0-1) of sorted[], interpolating between neighbours
+double sorted_quantile(const double *sorted, int n, double q);
+
+// q-quantile of x[] in any order; x is left untouched
+double sample_quantile(const double *x, int n, double q);
+
+// 95% percentile-bootstrap interval for the ratio quantile(y) / quantile(x),
+// from the given number of resamples of both sets
+void bootstrap_ratio_ci(const double *x, int nx, const double *y, int ny, double q,
+                        int resamples, uint64_t *rng, double *lo, double *hi);
+
+// 95% percentile-bootstrap interval for the q-quantile of x
+void bootstrap_quantile_ci(const double *x, int n, double q, int resamples, uint64_t *rng,
+                           double *lo, double *hi);
+
+// Two-sided Mann-Whitney U test: normal approximation with tie and
+// continuity corrections. Stores U for x in *u and returns the p-value.
+double mann_whitney(const double *x, int nx, const double *y, int ny, double *u);
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+
+#include "bench_core.h"
+#include "trace.h"
+
+#define TRACE_INITIAL_LABELS 256
+
+static size_t map_size(uint64_t capacity) {
+    return sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+}
+
+static int map_file(Trace *trace, uint64_t capacity) {
+    if (ftruncate(trace->fd, map_size(capacity)) < 0) {
+        return -1;
+    }
+
+    void *map;
+    if (trace->header == NULL) {
+        map = mmap(NULL, map_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+    } else {
+        map = mremap(trace->header, map_size(trace->capacity), map_size(capacity), MREMAP_MAYMOVE);
+    }
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    trace->header = map;
+    trace->records = (TraceRecord *)((char *)map + sizeof(TraceHeader));
+    trace->capacity = capacity;
+    return 0;
+}
+
+int trace_open(Trace *trace, const char *path, const char *tool, const char *config) {
+    struct utsname uts;
+    char brand[49] = {0};
+
+    memset(trace, 0, sizeof(*trace));
+    trace->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (trace->fd < 0) {
+        return -1;
+    }
+    if (map_file(trace, TRACE_INITIAL_RECORDS) < 0) {
+        close(trace->fd);
+        return -1;
+    }
+
+    TraceHeader *h = trace->header;
+    memcpy(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    h->version = TRACE_VERSION;
+    h->byte_order = TRACE_BYTE_ORDER;
+    h->header_size = sizeof(TraceHeader);
+    h->record_size = sizeof(TraceRecord);
+    h->clock_freq = bench_clock_freq();
+    h->clock = BENCH_CLOCK;
+    h->cpu_id = cpu_id();
+    h->hypervisor = cpu_hv();
+    get_cpu_info(h->cpu_vendor, brand);
+    snprintf(h->cpu_brand, sizeof(h->cpu_brand), "%s", brand);
+    if (uname(&uts) == 0) {
+        snprintf(h->kernel, sizeof(h->kernel), "%s %s", uts.release, uts.version);
+    }
+    snprintf(h->tool, sizeof(h->tool), "%s", tool);
+    snprintf(h->config, sizeof(h->config), "%s", config);
+
+    trace->last_time = get_system_time();
+    h->start_time = trace->last_time;
+
+    // Touch the first stretch of records so early samples don't fault
+    memset(trace->records, 0, TRACE_INITIAL_RECORDS * sizeof(TraceRecord));
+    return 0;
+}
+
+int trace_grow(Trace *trace) {
+    if (map_file(trace, trace->capacity * 2) < 0) {
+        perror("trace_grow");
+        return -1;
+    }
+    return 0;
+}
+
+static uint32_t label_hash(const char *label) {
+    uint32_t hash = 2166136261u;
+    for (; *label; label++) {
+        hash = (hash ^ (unsigned char)*label) * 16777619u;
+    }
+    return hash;
+}
+
+static int grow_labels(Trace *trace) {
+    uint32_t max_labels = trace->max_labels ? trace->max_labels * 2 : TRACE_INITIAL_LABELS;
+    uint32_t slots = max_labels * 2;
+
+    char **labels = realloc(trace->labels, max_labels * sizeof(char *));
+    if (labels != NULL) {
+        trace->labels = labels;
+    }
+    uint32_t *iterations = realloc(trace->label_iterations, max_labels * sizeof(uint32_t));
+    if (iterations != NULL) {
+        trace->label_iterations = iterations;
+    }
+    uint32_t *label_slots = calloc(slots, sizeof(uint32_t));
+    if (labels == NULL || iterations == NULL || label_slots == NULL) {
+        free(label_slots);
+        return -1;
+    }
+
+    free(trace->label_slots);
+    trace->label_slots = label_slots;
+    trace->label_mask = slots - 1;
+    trace->max_labels = max_labels;
+
+    for (uint32_t id = 0; id < trace->nlabels; id++) {
+        uint32_t slot = label_hash(labels[id]) & trace->label_mask;
+        while (label_slots[slot] != 0) {
+            slot = (slot + 1) & trace->label_mask;
+        }
+        label_slots[slot] = id + 1;
+    }
+    return 0;
+}
+
+int trace_label(Trace *trace, const char *label) {
+    if (trace->nlabels == trace->max_labels && grow_labels(trace) < 0) {
+        return -1;
+    }
+
+    uint32_t slot = label_hash(label) & trace->label_mask;
+    while (trace->label_slots[slot] != 0) {
+        uint32_t id = trace->label_slots[slot] - 1;
+        if (strcmp(trace->labels[id], label) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & trace->label_mask;
+    }
+
+    // Records carry the id in 16 bits
+    if (trace->nlabels > UINT16_MAX) {
+        errno = ENOSPC;
+        return -1;
+    }
+    uint32_t id = trace->nlabels++;
+    trace->labels[id] = strdup(label);
+    if (trace->labels[id] == NULL) {
+        trace->nlabels--;
+        return -1;
+    }
+    trace->label_iterations[id] = 1;
+    trace->label_slots[slot] = id + 1;
+    return id;
+}
+
+int trace_series(Trace *trace, const char *label, uint32_t iterations) {
+    int id = trace_label(trace, label);
+    if (id >= 0) {
+        trace->label_iterations[id] = iterations;
+    }
+    return id;
+}
+
+int trace_close(Trace *trace) {
+    TraceHeader *h = trace->header;
+    int status = 0;
+
+    h->nrecords = trace->nrecords;
+    h->labels_offset = map_size(trace->nrecords);
+    h->nlabels = trace->nlabels;
+
+    uint64_t offset = h->labels_offset;
+    munmap(trace->header, map_size(trace->capacity));
+    if (ftruncate(trace->fd, offset) < 0) {
+        status = -1;
+    }
+
+    for (uint32_t id = 0; id < trace->nlabels; id++) {
+        size_t len = strlen(trace->labels[id]) + 1;
+        if (pwrite(trace->fd, trace->labels[id], len, offset) != (ssize_t)len) {
+            status = -1;
+        }
+        offset += len;
+        free(trace->labels[id]);
+    }
+    size_t len = trace->nlabels * sizeof(uint32_t);
+    if (len > 0 && pwrite(trace->fd, trace->label_iterations, len, offset) != (ssize_t)len) {
+        status = -1;
+    }
+
+    free(trace->labels);
+    free(trace->label_iterations);
+    free(trace->label_slots);
+    if (close(trace->fd) < 0) {
+        status = -1;
+    }
+    return status;
+}
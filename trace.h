@@ -0,0 +1,110 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary trace file, version 1. Layout:
+//
+//   TraceHeader            fixed size, describes the machine and the run
+//   TraceRecord[nrecords]  fixed-width, timestamps delta-encoded
+//   label table            nlabels NUL-terminated strings, in id order,
+//                          then a uint32_t per label: the loop iterations
+//                          one sample of that series covers
+//
+// All fields are in the writer's native byte order; the analyzer refuses a
+// file whose byte_order marker doesn't match. Records are written through a
+// preallocated shared mapping of the file, so recording a sample is a few
+// stores with no syscall. The mapping doubles (ftruncate + mremap) when it
+// fills, and the label table and final counts are written on close.
+#define TRACE_MAGIC "XVTRACE"
+#define TRACE_VERSION 1
+#define TRACE_BYTE_ORDER 0x01020304
+#define TRACE_INITIAL_RECORDS (64 * 1024)
+
+enum {
+    TRACE_KIND_CLOCK,     // value is the absolute timestamp; rebases dt
+    TRACE_KIND_SAMPLE,    // value is a sample in ticks, source its series
+    TRACE_KIND_INTERVAL,  // value is the length of a refresh interval in ticks
+    TRACE_KIND_IRQ,       // value is an IRQ's count over the last interval,
+                          // source its row label
+    TRACE_NUM_KINDS
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint64_t clock_freq;      // ticks per second (cntfrq_el0 on AArch64)
+    uint32_t clock;           // BENCH_CLOCK backend
+    uint32_t cpu_id;          // MIDR_EL1, or the x86 CPUID signature
+    uint32_t hypervisor;      // cpu_hv()
+    uint32_t reserved;
+    char cpu_vendor[16];      // decoded MIDR or CPUID vendor
+    char cpu_brand[64];
+    char kernel[192];         // uname release and version
+    char tool[32];
+    char config[256];         // run configuration as "key=value" pairs
+    uint64_t start_time;      // timestamp the first dt is relative to
+    uint64_t nrecords;
+    uint64_t labels_offset;
+    uint64_t nlabels;
+} TraceHeader;
+
+// dt is the tick count since the previous record. A gap that doesn't fit
+// in 32 bits is written as a TRACE_KIND_CLOCK record first.
+typedef struct {
+    uint32_t dt;
+    uint16_t kind;
+    uint16_t source;
+    uint64_t value;
+} TraceRecord;
+
+typedef struct {
+    int fd;
+    TraceHeader *header;      // start of the mapping
+    TraceRecord *records;
+    uint64_t capacity;
+    uint64_t nrecords;
+    uint64_t last_time;
+    char **labels;
+    uint32_t *label_iterations;
+    uint32_t *label_slots;    // open-addressing table of label hash -> id + 1
+    uint32_t label_mask;
+    uint32_t nlabels;
+    uint32_t max_labels;
+} Trace;
+
+// Creates path and writes the header. config is free text describing the
+// run. Returns -1 with errno set on failure.
+int trace_open(Trace *trace, const char *path, const char *tool, const char *config);
+
+// Id for label, added to the label table the first time it is seen.
+// Returns -1 once the table holds UINT16_MAX + 1 labels, or out of memory.
+int trace_label(Trace *trace, const char *label);
+
+// trace_label for a sample series whose samples each cover iterations loops
+int trace_series(Trace *trace, const char *label, uint32_t iterations);
+
+int trace_grow(Trace *trace);
+
+static inline void trace_record(Trace *trace, uint64_t time, int kind, int source, uint64_t value) {
+    if (trace->nrecords + 2 > trace->capacity && trace_grow(trace) < 0) {
+        return;
+    }
+
+    uint64_t dt = time - trace->last_time;
+    if (time < trace->last_time || dt > UINT32_MAX) {
+        trace->records[trace->nrecords++] = (TraceRecord){0, TRACE_KIND_CLOCK, 0, time};
+        dt = 0;
+    }
+    trace->records[trace->nrecords++] = (TraceRecord){(uint32_t)dt, (uint16_t)kind, (uint16_t)source, value};
+    trace->last_time = time;
+}
+
+// Writes the label table and final counts, then closes the file
+int trace_close(Trace *trace);
+
+#endif
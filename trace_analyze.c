@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "trace.h"
+
+static const char *clock_names[] = {
+    "unknown", "cntvct_el0", "cntpct_el0", "rdtsc", "rdtscp", "CLOCK_MONOTONIC_RAW", "perf cycles",
+};
+
+// Everything known about one label id; a label is either a sample series
+// or an IRQ row, depending on the records that use it
+typedef struct {
+    Histogram *hist;
+    unsigned long long irq_total;
+    unsigned long long irq_max;
+    uint64_t irq_intervals;
+} LabelStats;
+
+static int check_header(const TraceHeader *h, size_t file_size) {
+    if (file_size < sizeof(TraceHeader) || memcmp(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        fprintf(stderr, "not a trace file\n");
+        return -1;
+    }
+    if (h->byte_order != TRACE_BYTE_ORDER) {
+        fprintf(stderr, "trace was written with a different byte order\n");
+        return -1;
+    }
+    if (h->version != TRACE_VERSION || h->header_size != sizeof(TraceHeader) ||
+        h->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "unsupported trace version %u\n", h->version);
+        return -1;
+    }
+    if (h->labels_offset != sizeof(TraceHeader) + h->nrecords * sizeof(TraceRecord) ||
+        h->labels_offset > file_size || h->clock_freq == 0) {
+        fprintf(stderr, "truncated trace (was the writer closed?)\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void print_header(const TraceHeader *h) {
+    printf("Trace: %s, version %u\n", h->tool, h->version);
+    printf("Configuration: %s\n", h->config);
+    printf("Kernel: %s\n", h->kernel);
+    printf("CPU Vendor: %s (id register 0x%08x)\n", h->cpu_vendor, h->cpu_id);
+    printf("CPU Brand: %s\n", h->cpu_brand);
+    printf("Hypervisor present: %s\n", h->hypervisor ? "Yes" : "No");
+    printf("Clock: %s\n", h->clock < sizeof(clock_names) / sizeof(clock_names[0]) ? clock_names[h->clock] : "unknown");
+    printf("CPU Frequency: %.2f MHz\n", (double)h->clock_freq / 1000000);
+    printf("Records: %llu, labels: %llu\n", (unsigned long long)h->nrecords, (unsigned long long)h->nlabels);
+}
+
+int main(int argc, char **argv) {
+    static Histogram interval_hist;
+    const char *path = NULL;
+    int dump_buckets = FALSE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0) {
+            dump_buckets = TRUE;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-b] trace-file\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "not a trace file\n");
+        return 1;
+    }
+
+    // The whole file is mapped and read front to back once, so the kernel
+    // can read ahead and drop pages behind; traces larger than RAM stream
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+    const TraceHeader *h = (const TraceHeader *)map;
+    if (check_header(h, st.st_size) < 0) {
+        return 1;
+    }
+    bench_clock_set_freq(h->clock_freq);
+    print_header(h);
+
+    uint64_t nlabels = h->nlabels;
+    const char **labels = calloc(nlabels + 1, sizeof(char *));
+    LabelStats *stats = calloc(nlabels + 1, sizeof(LabelStats));
+    const char *p = map + h->labels_offset, *end = map + st.st_size;
+    for (uint64_t id = 0; id < nlabels; id++) {
+        const char *nul = memchr(p, '\0', end - p);
+        if (nul == NULL) {
+            fprintf(stderr, "truncated label table\n");
+            return 1;
+        }
+        labels[id] = p;
+        p = nul + 1;
+    }
+    uint32_t *iterations = calloc(nlabels + 1, sizeof(uint32_t));
+    if ((size_t)(end - p) < nlabels * sizeof(uint32_t)) {
+        fprintf(stderr, "truncated label table\n");
+        return 1;
+    }
+    memcpy(iterations, p, nlabels * sizeof(uint32_t));
+
+    const TraceRecord *records = (const TraceRecord *)(map + sizeof(TraceHeader));
+    uint64_t time = h->start_time;
+    uint64_t first_time = 0, last_time = 0;
+    uint64_t monitored = 0;
+    hist_init(&interval_hist);
+
+    for (uint64_t r = 0; r < h->nrecords; r++) {
+        const TraceRecord *rec = &records[r];
+        if (rec->kind == TRACE_KIND_CLOCK) {
+            time = rec->value;
+            continue;
+        }
+        time += rec->dt;
+        if (first_time == 0) first_time = time;
+        last_time = time;
+
+        if (rec->kind == TRACE_KIND_INTERVAL) {
+            hist_record(&interval_hist, rec->value);
+            monitored += rec->value;
+            continue;
+        }
+        if (rec->source >= nlabels) {
+            continue;
+        }
+
+        LabelStats *s = &stats[rec->source];
+        if (rec->kind == TRACE_KIND_SAMPLE) {
+            if (s->hist == NULL) {
+                s->hist = malloc(sizeof(Histogram));
+                hist_init(s->hist);
+            }
+            hist_record(s->hist, rec->value);
+        } else if (rec->kind == TRACE_KIND_IRQ) {
+            s->irq_total += rec->value;
+            s->irq_intervals++;
+            if (rec->value > s->irq_max) s->irq_max = rec->value;
+        }
+    }
+
+    printf("Span: %.3f ms\n", ticks_to_ms(last_time - first_time));
+
+    for (uint64_t id = 0; id < nlabels; id++) {
+        if (stats[id].hist != NULL) {
+            printf("\n");
+            print_histogram(stats[id].hist, labels[id], iterations[id] > 0 ? iterations[id] : 1);
+            if (dump_buckets) {
+                print_histogram_buckets(stats[id].hist);
+            }
+        }
+    }
+
+    if (interval_hist.total > 0) {
+        double seconds = ticks_to_ms(monitored) / 1000.0;
+
+        printf("\n");
+        print_histogram(&interval_hist, "Refresh interval", 1);
+        printf("\nInterrupts over %.3f s of monitoring:\n", seconds);
+        printf("  %-16s %14s %12s %14s %12s %18s\n", "IRQ", "Total", "Rate/s", "Max/interval",
+               "Intervals", "Avg between (ms)");
+        for (uint64_t id = 0; id < nlabels; id++) {
+            const LabelStats *s = &stats[id];
+            if (s->irq_intervals == 0) {
+                continue;
+            }
+            printf("  %-16s %14llu %12.1f %14llu %12llu %18.3f\n", labels[id], s->irq_total,
+                   s->irq_total / seconds, s->irq_max, (unsigned long long)s->irq_intervals,
+                   seconds * 1000.0 / s->irq_total);
+        }
+    }
+
+    for (uint64_t id = 0; id < nlabels; id++) {
+        free(stats[id].hist);
+    }
+    free(stats);
+    free(iterations);
+    free(labels);
+    munmap((void *)map, st.st_size);
+    close(fd);
+    return 0;
+}
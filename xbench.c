@@ -0,0 +1,561 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "bench_core.h"
+#include "histogram.h"
+#include "isolation.h"
+#include "proc_stat.h"
+#include "load_gen.h"
+#include "report.h"
+
+#define XBENCH_MAX_CPUS 1024
+
+// Defaults match the standalone tools
+#define DEFAULT_FORK_TESTS 10
+#define DEFAULT_DURATION 5.0
+#define DEFAULT_WAKEUP_US 50
+
+typedef struct {
+    const char *command;
+    const char *environment;  // native, xvisor, kvm, ... as given or detected
+    int samples;          // 0: the command's default
+    int iterations;       // operations inside each sample, 0: the command's default
+    int serialized;
+    int tests;            // forks per run
+    int repeats;
+    int cpus[XBENCH_MAX_CPUS];
+    int ncpus;            // 0: one run wherever isolation left us
+    double duration;      // interrupts: seconds between snapshots
+    int load_modes[LOAD_NUM_MODES];
+    int nload_modes;
+    double load_rate;
+    int wakeup_us;        // wakeup: timer interval
+    IsolationConfig iso;
+} XbenchConfig;
+
+typedef struct XbenchCommand XbenchCommand;
+typedef void (*XbenchRun)(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu);
+
+// Commands that run pinned to each CPU of --cpus in turn
+struct XbenchCommand {
+    const char *name;
+    XbenchRun run;
+    int samples;          // defaults when --samples/--iterations aren't given
+    int iterations;
+};
+
+// Read by the sample functions, which isolation_warmup() calls without
+// arguments
+static int sample_iterations = 1;
+static size_t page_size;
+static int wakeup_fd = -1;
+static struct itimerspec wakeup_spec;
+static uint64_t wakeup_ticks;
+
+static inline uint64_t time_diff() {
+    uint64_t start, end;
+    if (sample_iterations <= 1) {
+        // Back-to-back reads measure the clock itself: no overhead removed
+        start = get_system_time();
+        end = get_system_time();
+        return end - start;
+    }
+    start = get_system_time();
+    for (volatile int i = 0; i < sample_iterations; i++) {
+    }
+    end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+static inline uint64_t time_diff_serialized() {
+    uint64_t start, end;
+    if (sample_iterations <= 1) {
+        start = get_system_time_start();
+        end = get_system_time_end();
+        return end - start;
+    }
+    start = get_system_time_start();
+    for (volatile int i = 0; i < sample_iterations; i++) {
+    }
+    end = get_system_time_end();
+    return bench_elapsed(start, end, TRUE);
+}
+
+// A syscall that does nothing and is never cached by libc: pure entry and
+// exit cost, which includes any trap to the hypervisor
+static uint64_t syscall_sample() {
+    uint64_t start = get_system_time();
+    for (int i = 0; i < sample_iterations; i++) {
+        syscall(SYS_getppid);
+    }
+    uint64_t end = get_system_time();
+    return bench_elapsed(start, end, FALSE);
+}
+
+// First write to each page of a fresh mapping. Huge pages are refused, so
+// every page is one 4 KiB fault; mmap and munmap stay outside the interval.
+static uint64_t pagefault_sample() {
+    size_t size = (size_t)sample_iterations * page_size;
+    char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        return 0;
+    }
+    madvise(buf, size, MADV_NOHUGEPAGE);
+    uint64_t start = get_system_time();
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        ((volatile char *)buf)[offset] = 1;
+    }
+    uint64_t end = get_system_time();
+    munmap(buf, size);
+    return bench_elapsed(start, end, FALSE);
+}
+
+// Time past the deadline of a short one-shot timer: the timer interrupt,
+// the wakeup and the return from read(), plus the arming syscall
+static uint64_t wakeup_sample() {
+    uint64_t expirations;
+    uint64_t start = get_system_time();
+    if (timerfd_settime(wakeup_fd, 0, &wakeup_spec, NULL) < 0 ||
+        read(wakeup_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return 0;
+    }
+    uint64_t elapsed = bench_elapsed(start, get_system_time(), FALSE);
+    return elapsed > wakeup_ticks ? elapsed - wakeup_ticks : 0;
+}
+
+// Parses "0,2-3" into cpus[]; returns the count or -1
+static int parse_cpu_list(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (n == max) {
+                return -1;
+            }
+            cpus[n++] = (int)cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return n;
+}
+
+static int pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "Cannot pin to CPU %d: ", cpu);
+        perror("sched_setaffinity");
+        return -1;
+    }
+    return 0;
+}
+
+static void row_begin(Report *r, const char *command, const char *metric, int repeat, int cpu) {
+    report_row_begin(r);
+    report_str(r, "command", command);
+    report_str(r, "metric", metric);
+    report_u64(r, "repeat", repeat);
+    report_int(r, "cpu", cpu);
+}
+
+// Warms up, then records one sample() per sample into a histogram and
+// reports it per iteration
+static void run_sampled(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, const char *metric,
+                        uint64_t (*sample)(), int repeat, int cpu) {
+    static Histogram hist;
+    WarmupResult warmup;
+    int samples = cfg->samples > 0 ? cfg->samples : cmd->samples;
+
+    sample_iterations = cfg->iterations > 0 ? cfg->iterations : cmd->iterations;
+    isolation_warmup(&cfg->iso, sample, &warmup);
+    hist_init(&hist);
+    for (int i = 0; i < samples; i++) {
+        hist_record(&hist, sample());
+    }
+
+    row_begin(r, cmd->name, metric, repeat, cpu);
+    report_u64(r, "warmup_samples", warmup.samples);
+    report_u64(r, "warmup_stable", warmup.stable);
+    report_histogram(r, &hist, sample_iterations);
+    report_row_end(r);
+}
+
+static void run_cpu(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu) {
+    if (cfg->serialized) {
+        run_sampled(r, cfg, cmd, "timing_serialized", time_diff_serialized, repeat, cpu);
+    } else {
+        run_sampled(r, cfg, cmd, "timing", time_diff, repeat, cpu);
+    }
+}
+
+static void run_syscall(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu) {
+    run_sampled(r, cfg, cmd, "getppid", syscall_sample, repeat, cpu);
+}
+
+static void run_pagefault(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu) {
+    page_size = sysconf(_SC_PAGESIZE);
+    run_sampled(r, cfg, cmd, "anonymous_write", pagefault_sample, repeat, cpu);
+}
+
+static void run_wakeup(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu) {
+    if (wakeup_fd < 0 && (wakeup_fd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0) {
+        perror("timerfd_create");
+        return;
+    }
+    memset(&wakeup_spec, 0, sizeof(wakeup_spec));
+    wakeup_spec.it_value.tv_sec = cfg->wakeup_us / 1000000;
+    wakeup_spec.it_value.tv_nsec = (cfg->wakeup_us % 1000000) * 1000L;
+    wakeup_ticks = (uint64_t)cfg->wakeup_us * bench_clock_freq() / 1000000;
+    run_sampled(r, cfg, cmd, "timerfd_late", wakeup_sample, repeat, cpu);
+}
+
+static void run_fork(Report *r, const XbenchConfig *cfg, const XbenchCommand *cmd, int repeat, int cpu) {
+    static Histogram phase_hist[FORK_NUM_PHASES];
+    WarmupResult warmup;
+    int failed = 0;
+
+    isolation_warmup(&cfg->iso, measure_fork_time, &warmup);
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        hist_init(&phase_hist[p]);
+    }
+    for (int i = 0; i < cfg->tests; i++) {
+        uint64_t phases[FORK_NUM_PHASES];
+        if (measure_fork_phases(phases) < 0) {
+            failed++;
+            continue;
+        }
+        for (int p = 0; p < FORK_NUM_PHASES; p++) {
+            hist_record(&phase_hist[p], phases[p]);
+        }
+    }
+
+    for (int p = 0; p < FORK_NUM_PHASES; p++) {
+        row_begin(r, cmd->name, fork_phase_names[p], repeat, cpu);
+        report_u64(r, "failed", failed);
+        report_histogram(r, &phase_hist[p], 1);
+        report_row_end(r);
+    }
+}
+
+static int cpu_selected(const XbenchConfig *cfg, int cpu) {
+    if (cfg->ncpus == 0) {
+        return TRUE;
+    }
+    for (int i = 0; i < cfg->ncpus; i++) {
+        if (cfg->cpus[i] == cpu) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void cpu_rates_row(Report *r, const XbenchConfig *cfg, int repeat, int cpu,
+                          const SystemSnapshot *curr, const SystemSnapshot *prev) {
+    CpuRates rates;
+    if (system_cpu_rates(curr, prev, cpu, &rates) < 0) {
+        return;
+    }
+
+    row_begin(r, "interrupts", "cpu_activity", repeat, cpu);
+    report_double(r, "seconds", rates.seconds);
+    report_double(r, "irqs_per_s", rates.irqs_per_s);
+    for (int f = 0; f < CPU_TIME_FIELDS; f++) {
+        char name[REPORT_FIELD_LEN];
+        snprintf(name, sizeof(name), "%s_pct", cpu_time_names[f]);
+        report_double(r, name, rates.time_pct[f]);
+    }
+    for (int s = 0; s < curr->nsoftirqs; s++) {
+        char name[REPORT_FIELD_LEN];
+        snprintf(name, sizeof(name), "%s_per_s", curr->softirq_names[s]);
+        report_double(r, name, rates.softirqs_per_s[s]);
+    }
+    report_row_end(r);
+}
+
+static void run_interrupts(Report *r, const XbenchConfig *cfg, int repeat, SystemFiles *files,
+                           SystemSnapshot *before, SystemSnapshot *after) {
+    LoadGen gens[LOAD_NUM_MODES];
+    int ngens = 0;
+    LoadConfig base;
+
+    load_config_init(&base, LOAD_UDP);
+    base.rate = cfg->load_rate;
+    read_system(files, before);
+    for (int i = 0; i < cfg->nload_modes; i++) {
+        LoadConfig load = base;
+        load.mode = cfg->load_modes[i];
+        if (load_gen_start(&gens[ngens], &load) == 0) {
+            ngens++;
+        }
+    }
+
+    struct timespec ts;
+    ts.tv_sec = (time_t)cfg->duration;
+    ts.tv_nsec = (long)((cfg->duration - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) < 0) {
+    }
+
+    for (int i = 0; i < ngens; i++) {
+        load_gen_stop(&gens[i]);
+    }
+    read_system(files, after);
+
+    double seconds = (double)(after->timestamp - before->timestamp) / (double)bench_clock_freq();
+    for (int i = 0; i < ngens; i++) {
+        row_begin(r, "interrupts", "load", repeat, -1);
+        report_str(r, "mode", load_mode_names[gens[i].cfg.mode]);
+        report_double(r, "target_per_s", gens[i].cfg.rate);
+        report_double(r, "achieved_per_s", load_gen_rate(&gens[i]));
+        report_u64(r, "ops", gens[i].ops);
+        report_u64(r, "errors", gens[i].errors);
+        report_u64(r, "late", gens[i].late);
+        report_row_end(r);
+    }
+
+    // Rows that appeared or moved between the snapshots are matched by label,
+    // and columns by CPU number, since a CPU going offline shifts them
+    InterruptSnapshot *curr = &after->irqs, *prev = &before->irqs;
+    for (int i = 0; i < curr->nirqs; i++) {
+        int row = snapshot_find_row(prev, &curr->info[i], i);
+        uint64_t count = 0;
+        for (int column = 0; column < curr->ncpus; column++) {
+            int cpu = snapshot_cpu_id(curr, column);
+            if (!cpu_selected(cfg, cpu)) {
+                continue;
+            }
+            int prev_column = snapshot_cpu_column(prev, cpu);
+            uint32_t c = snapshot_cpu_counts(curr, column)[i];
+            uint32_t p = row >= 0 && prev_column >= 0 ? snapshot_cpu_counts(prev, prev_column)[row] : 0;
+            count += (uint32_t)(c - p);
+        }
+        if (count == 0) {
+            continue;
+        }
+        row_begin(r, "interrupts", "irq", repeat, -1);
+        report_str(r, "irq", curr->info[i].label);
+        report_str(r, "name", curr->info[i].name);
+        report_u64(r, "count", count);
+        report_double(r, "per_s", count / seconds);
+        report_row_end(r);
+    }
+
+    for (int cpu = 0; cpu < after->ncpus; cpu++) {
+        if (cpu_selected(cfg, cpu)) {
+            cpu_rates_row(r, cfg, repeat, cpu, after, before);
+        }
+    }
+    if (cfg->ncpus == 0) {
+        cpu_rates_row(r, cfg, repeat, -1, after, before);
+    }
+}
+
+// The suite is every command here, in order
+static const XbenchCommand commands[] = {
+    {"cpu", run_cpu, 1000000, 1},
+    {"fork", run_fork, 0, 0},
+    {"syscall", run_syscall, 10000, 100},
+    {"pagefault", run_pagefault, 1000, 64},
+    {"wakeup", run_wakeup, 1000, 1},
+};
+
+#define NUM_COMMANDS (int)(sizeof(commands) / sizeof(commands[0]))
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s <cpu|fork|syscall|pagefault|wakeup|suite|interrupts> [options]\n"
+            "  --samples N       timed samples per run (cpu %d, syscall %d, pagefault %d, wakeup %d)\n"
+            "  --iterations N    operations per sample (cpu 1: back-to-back reads, syscall %d, pagefault %d pages)\n"
+            "  --serialized      cpu: serialized clock reads\n"
+            "  --tests N         fork: forks per run (default %d)\n"
+            "  --interval US     wakeup: timer interval in microseconds (default %d)\n"
+            "  --env NAME        environment tag: native, xvisor, kvm, ... (default: detected)\n"
+            "  --duration S      interrupts: seconds between snapshots (default %.0f)\n"
+            "  --load LIST       interrupts: load generator modes during the run, or none\n"
+            "  --rate R          interrupts: operations per second per load mode (default 1)\n"
+            "  --repeats N       runs of the whole measurement (default 1)\n"
+            "  --cpus LIST       CPUs to run on in turn, e.g. 0,2-3; interrupts: CPUs to report\n"
+            "  --format F        text, json or csv (default text)\n"
+            "  --output FILE     write results to FILE instead of stdout\n"
+            "  --cpu N, --fifo PRIO, --mlock, --warmup N   isolation, as in the other tools\n",
+            prog, commands[0].samples, commands[2].samples, commands[3].samples, commands[4].samples,
+            commands[2].iterations, commands[3].iterations, DEFAULT_FORK_TESTS, DEFAULT_WAKEUP_US,
+            DEFAULT_DURATION);
+}
+
+int main(int argc, char **argv) {
+    XbenchConfig cfg;
+    IsolationState iso_state;
+    const char *output = NULL;
+    int format = REPORT_TEXT;
+
+    const XbenchCommand *selected = NULL;
+    int suite = argc >= 2 && strcmp(argv[1], "suite") == 0;
+    for (int c = 0; c < NUM_COMMANDS && argc >= 2; c++) {
+        if (strcmp(argv[1], commands[c].name) == 0) {
+            selected = &commands[c];
+        }
+    }
+    if (argc < 2 || (selected == NULL && !suite && strcmp(argv[1], "interrupts") != 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.command = argv[1];
+    cfg.tests = DEFAULT_FORK_TESTS;
+    cfg.wakeup_us = DEFAULT_WAKEUP_US;
+    cfg.repeats = 1;
+    cfg.duration = DEFAULT_DURATION;
+    cfg.load_rate = 1.0;
+    isolation_config_init(&cfg.iso);
+
+    for (int i = 2; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (isolation_parse_arg(&cfg.iso, argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "--samples") == 0 && has_value) {
+            cfg.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iterations") == 0 && has_value) {
+            cfg.iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--serialized") == 0) {
+            cfg.serialized = TRUE;
+        } else if (strcmp(argv[i], "--tests") == 0 && has_value) {
+            cfg.tests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--interval") == 0 && has_value) {
+            cfg.wakeup_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--env") == 0 && has_value) {
+            cfg.environment = argv[++i];
+        } else if (strcmp(argv[i], "--repeats") == 0 && has_value) {
+            cfg.repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && has_value) {
+            cfg.duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && has_value) {
+            cfg.load_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--load") == 0 && has_value) {
+            cfg.nload_modes = load_modes_parse(argv[++i], cfg.load_modes, LOAD_NUM_MODES);
+            if (cfg.nload_modes < 0) {
+                fprintf(stderr, "Unknown load mode in %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpus") == 0 && has_value) {
+            cfg.ncpus = parse_cpu_list(argv[++i], cfg.cpus, XBENCH_MAX_CPUS);
+            if (cfg.ncpus <= 0) {
+                fprintf(stderr, "Bad CPU list: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && has_value) {
+            format = report_format_parse(argv[++i]);
+            if (format < 0) {
+                fprintf(stderr, "Unknown format: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+            output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.samples < 0 || cfg.iterations < 0 || cfg.tests <= 0 || cfg.repeats <= 0 ||
+        cfg.duration <= 0 || cfg.load_rate <= 0 || cfg.wakeup_us <= 0) {
+        fprintf(stderr, "Counts, durations and rates must be positive\n");
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror(output);
+        return 1;
+    }
+
+    // Pin and lock first so clock calibration runs under the same isolation
+    isolation_apply(&cfg.iso, &iso_state);
+    if (bench_clock_init() < 0) {
+        return 1;
+    }
+    if (cfg.environment == NULL) {
+        cfg.environment = bench_environment();
+    }
+    if (iso_state.memory_locked && (suite || strcmp(cfg.command, "pagefault") == 0)) {
+        fprintf(stderr, "Warning: --mlock populates new mappings, so pagefault measures no faults\n");
+    }
+
+    Report report;
+    report_begin(&report, out, format, cfg.command);
+    report_str(&report, "environment", cfg.environment);
+    report_int(&report, "pinned_cpu", iso_state.cpu);
+    report_u64(&report, "fifo_priority", iso_state.fifo_priority);
+    report_u64(&report, "memory_locked", iso_state.memory_locked);
+    report_u64(&report, "repeats", cfg.repeats);
+    report_header_end(&report);
+
+    if (strcmp(cfg.command, "interrupts") == 0) {
+        SystemFiles files;
+        SystemSnapshot before, after;
+        if (system_files_open(&files) < 0 || system_snapshot_init(&before) < 0 ||
+            system_snapshot_init(&after) < 0) {
+            perror("Failed to open /proc files");
+            return 1;
+        }
+        for (int repeat = 0; repeat < cfg.repeats; repeat++) {
+            run_interrupts(&report, &cfg, repeat, &files, &before, &after);
+        }
+        system_snapshot_free(&before);
+        system_snapshot_free(&after);
+        system_files_close(&files);
+    } else {
+        // Every repeat visits every CPU, so slow drift spreads over all of them
+        int nruns = cfg.ncpus > 0 ? cfg.ncpus : 1;
+        for (int repeat = 0; repeat < cfg.repeats; repeat++) {
+            for (int c = 0; c < nruns; c++) {
+                int cpu = cfg.ncpus > 0 ? cfg.cpus[c] : iso_state.cpu;
+                if (cfg.ncpus > 0 && pin_to_cpu(cpu) < 0) {
+                    continue;
+                }
+                for (int k = 0; k < NUM_COMMANDS; k++) {
+                    if (suite || selected == &commands[k]) {
+                        commands[k].run(&report, &cfg, &commands[k], repeat, cpu);
+                    }
+                }
+            }
+        }
+    }
+
+    report_end(&report);
+    if (wakeup_fd >= 0) {
+        close(wakeup_fd);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench_core.h"
+#include "results.h"
+#include "stats.h"
+
+#define KEY_LEN 512
+#define MAX_COMPARE_FIELDS 16
+
+// Exit status when any metric got slower, so scripts can gate on it
+#define EXIT_REGRESSION 2
+
+typedef struct {
+    double threshold;     // smallest change that counts, as a fraction
+    double alpha;         // significance level for the U test
+    int resamples;
+    uint64_t seed;
+    const char *fields[MAX_COMPARE_FIELDS];
+    int nfields;
+    int overhead;         // base is native, new a guest: report ratios only
+} CompareConfig;
+
+// One measurement in the overhead report
+typedef struct {
+    char key[KEY_LEN];
+    const char *field;
+    double native;
+    double guest;
+    double ratio;         // how many times worse the guest is
+} Overhead;
+
+enum {
+    VERDICT_UNCHANGED,
+    VERDICT_FASTER,
+    VERDICT_SLOWER,
+    VERDICT_TOO_FEW,
+    VERDICT_COUNT
+};
+
+static const char *verdict_names[VERDICT_COUNT] = { "unchanged", "faster", "slower", "too few runs" };
+
+// Fields are times, where lower is better, except rates and bandwidths
+static int higher_is_better(const char *field) {
+    static const char *suffixes[] = { "_gbps", "_per_s" };
+    size_t len = strlen(field);
+
+    if (strcmp(field, "gbps") == 0) {
+        return TRUE;
+    }
+    for (size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); s++) {
+        size_t n = strlen(suffixes[s]);
+        if (len >= n && strcmp(field + len - n, suffixes[s]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Values of one field from every row with the given key
+static int collect(const ResultSet *set, const char *key, const char *field, double *values, int max) {
+    char row_key[KEY_LEN];
+    int n = 0;
+
+    for (int r = 0; r < set->nrows && n < max; r++) {
+        double value;
+        result_key(&set->rows[r], row_key, sizeof(row_key));
+        if (strcmp(row_key, key) == 0 && result_number(&set->rows[r], field, &value) == 0) {
+            values[n++] = value;
+        }
+    }
+    return n;
+}
+
+static int has_key(const ResultSet *set, const char *key) {
+    char row_key[KEY_LEN];
+    for (int r = 0; r < set->nrows; r++) {
+        result_key(&set->rows[r], row_key, sizeof(row_key));
+        if (strcmp(row_key, key) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// TRUE if no earlier row of the set has the same key as row r
+static int first_with_key(const ResultSet *set, int r, const char *key) {
+    char seen[KEY_LEN];
+    for (int s = 0; s < r; s++) {
+        result_key(&set->rows[s], seen, sizeof(seen));
+        if (strcmp(seen, key) == 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int compare_field(const CompareConfig *cfg, const ResultSet *base, const ResultSet *new_set,
+                         const char *key, const char *field, uint64_t *rng, int *printed_key) {
+    double *x = malloc(base->nrows * sizeof(double));
+    double *y = malloc(new_set->nrows * sizeof(double));
+    int verdict = -1;
+
+    if (x == NULL || y == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int nx = collect(base, key, field, x, base->nrows);
+    int ny = collect(new_set, key, field, y, new_set->nrows);
+    if (nx == 0 || ny == 0) {
+        free(x);
+        free(y);
+        return -1;
+    }
+
+    double base_med = sample_quantile(x, nx, 0.5), new_med = sample_quantile(y, ny, 0.5);
+    double base_lo, base_hi, new_lo, new_hi, ratio_lo, ratio_hi, u;
+    bootstrap_quantile_ci(x, nx, 0.5, cfg->resamples, rng, &base_lo, &base_hi);
+    bootstrap_quantile_ci(y, ny, 0.5, cfg->resamples, rng, &new_lo, &new_hi);
+    bootstrap_ratio_ci(x, nx, y, ny, 0.5, cfg->resamples, rng, &ratio_lo, &ratio_hi);
+    double p = mann_whitney(x, nx, y, ny, &u);
+    double ratio = base_med != 0 ? new_med / base_med : NAN;
+
+    int higher = higher_is_better(field);
+    if (nx < 2 || ny < 2) {
+        verdict = VERDICT_TOO_FEW;
+    } else if (p < cfg->alpha && ratio > 1 + cfg->threshold) {
+        verdict = higher ? VERDICT_FASTER : VERDICT_SLOWER;
+    } else if (p < cfg->alpha && ratio < 1 - cfg->threshold) {
+        verdict = higher ? VERDICT_SLOWER : VERDICT_FASTER;
+    } else {
+        verdict = VERDICT_UNCHANGED;
+    }
+
+    if (!*printed_key) {
+        printf("\n%s\n", key);
+        *printed_key = TRUE;
+    }
+    printf("  %-12s n %3d/%-3d base %12.3f [%.3f, %.3f]  new %12.3f [%.3f, %.3f]  change %+7.2f%% [%+.2f%%, %+.2f%%]  p %.4f  %s\n",
+           field, nx, ny, base_med, base_lo, base_hi, new_med, new_lo, new_hi, (ratio - 1) * 100,
+           (ratio_lo - 1) * 100, (ratio_hi - 1) * 100, p, verdict_names[verdict]);
+    free(x);
+    free(y);
+    return verdict;
+}
+
+static void print_set(const char *label, const ResultSet *set) {
+    const char *env = result_get(&set->system, "environment");
+    const char *kernel = result_get(&set->system, "kernel");
+    const char *brand = result_get(&set->system, "cpu_brand");
+    const char *clock = result_get(&set->system, "clock");
+    const char *hv = result_get(&set->system, "hypervisor");
+
+    printf("%s: %s (%d rows; %s, kernel %s, %s, clock %s, hypervisor %s)\n", label, set->path, set->nrows,
+           env ? env : "environment not recorded", kernel ? kernel : "?", brand ? brand : "?",
+           clock ? clock : "?", hv ? hv : "?");
+}
+
+static int compare_overhead(const void *a, const void *b) {
+    double x = ((const Overhead *)a)->ratio, y = ((const Overhead *)b)->ratio;
+    // Largest ratio first, unknown ratios last
+    if (isnan(x) || isnan(y)) {
+        return isnan(x) - isnan(y);
+    }
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Guest over native median for every measurement both runs have, worst
+// virtualization tax first
+static void overhead_report(const CompareConfig *cfg, const ResultSet *native, const ResultSet *guest) {
+    const char *native_env = result_get(&native->system, "environment");
+    const char *guest_env = result_get(&guest->system, "environment");
+    Overhead *entries = NULL;
+    int nentries = 0, max_entries = 0;
+    char key[KEY_LEN];
+
+    if (native_env != NULL && strcmp(native_env, "native") != 0) {
+        printf("Warning: the first file should be a native run, not %s\n", native_env);
+    }
+    if (native_env != NULL && guest_env != NULL && strcmp(native_env, guest_env) == 0) {
+        printf("Warning: both files come from the same environment (%s)\n", guest_env);
+    }
+
+    double *x = malloc(native->nrows * sizeof(double));
+    double *y = malloc(guest->nrows * sizeof(double));
+    if (x == NULL || y == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int r = 0; r < native->nrows; r++) {
+        result_key(&native->rows[r], key, sizeof(key));
+        if (!first_with_key(native, r, key)) {
+            continue;
+        }
+        for (int f = 0; f < cfg->nfields; f++) {
+            int nx = collect(native, key, cfg->fields[f], x, native->nrows);
+            int ny = collect(guest, key, cfg->fields[f], y, guest->nrows);
+            if (nx == 0 || ny == 0) {
+                continue;
+            }
+            if (nentries == max_entries) {
+                max_entries = max_entries > 0 ? max_entries * 2 : 64;
+                entries = realloc(entries, max_entries * sizeof(Overhead));
+                if (entries == NULL) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            Overhead *o = &entries[nentries++];
+            snprintf(o->key, sizeof(o->key), "%s", key);
+            o->field = cfg->fields[f];
+            o->native = sample_quantile(x, nx, 0.5);
+            o->guest = sample_quantile(y, ny, 0.5);
+            if (higher_is_better(o->field)) {
+                o->ratio = o->guest > 0 ? o->native / o->guest : NAN;
+            } else {
+                o->ratio = o->native > 0 ? o->guest / o->native : NAN;
+            }
+        }
+    }
+    free(x);
+    free(y);
+
+    qsort(entries, nentries, sizeof(Overhead), compare_overhead);
+    printf("\nGuest over native (native over guest for rates), medians over repeats, largest overhead first:\n");
+    printf("%8s %14s %14s %14s  %-10s %s\n", "ratio", "native", "guest", "delta", "field", "measurement");
+    for (int e = 0; e < nentries; e++) {
+        const Overhead *o = &entries[e];
+        printf("%7.2fx %14.3f %14.3f %+14.3f  %-10s %s\n", o->ratio, o->native, o->guest,
+               o->guest - o->native, o->field, o->key);
+    }
+    free(entries);
+}
+
+static int parse_fields(char *list, CompareConfig *cfg) {
+    cfg->nfields = 0;
+    for (char *field = strtok(list, ","); field != NULL; field = strtok(NULL, ",")) {
+        if (cfg->nfields == MAX_COMPARE_FIELDS) {
+            return -1;
+        }
+        cfg->fields[cfg->nfields++] = field;
+    }
+    return cfg->nfields > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    static char default_fields[] = "p50_ns,p99_ns";
+    CompareConfig cfg;
+    const char *paths[2] = {NULL, NULL};
+    int npaths = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.threshold = 0.05;
+    cfg.alpha = 0.05;
+    cfg.resamples = 2000;
+    cfg.seed = 1;
+    parse_fields(default_fields, &cfg);
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-t") == 0 && has_value) {
+            cfg.threshold = atof(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-a") == 0 && has_value) {
+            cfg.alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-B") == 0 && has_value) {
+            cfg.resamples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && has_value) {
+            cfg.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            cfg.overhead = TRUE;
+        } else if (strcmp(argv[i], "-f") == 0 && has_value) {
+            if (parse_fields(argv[++i], &cfg) < 0) {
+                fprintf(stderr, "Bad field list\n");
+                return 1;
+            }
+        } else if (npaths < 2 && argv[i][0] != '-') {
+            paths[npaths++] = argv[i];
+        } else {
+            npaths = 0;
+            break;
+        }
+    }
+    if (npaths != 2 || cfg.resamples <= 0 || cfg.alpha <= 0 || cfg.threshold < 0) {
+        fprintf(stderr, "usage: %s [-o] [-t percent] [-a alpha] [-f field,...] [-B resamples] [-s seed] base new\n",
+                argv[0]);
+        return 1;
+    }
+
+    ResultSet base, new_set;
+    if (results_load(paths[0], &base) < 0) {
+        return 1;
+    }
+    if (results_load(paths[1], &new_set) < 0) {
+        results_free(&base);
+        return 1;
+    }
+
+    print_set(cfg.overhead ? "Native" : "Base", &base);
+    print_set(cfg.overhead ? "Guest " : "New ", &new_set);
+    const char *base_clock = result_get(&base.system, "clock");
+    const char *new_clock = result_get(&new_set.system, "clock");
+    if (base_clock && new_clock && strcmp(base_clock, new_clock) != 0) {
+        printf("Warning: the runs used different clocks (%s, %s)\n", base_clock, new_clock);
+    }
+    if (cfg.overhead) {
+        overhead_report(&cfg, &base, &new_set);
+        results_free(&base);
+        results_free(&new_set);
+        return 0;
+    }
+    printf("Medians with 95%% bootstrap intervals (%d resamples), Mann-Whitney U p-values.\n", cfg.resamples);
+    printf("A change counts when p < %.3f and the medians differ by more than %.1f%%.\n",
+           cfg.alpha, cfg.threshold * 100);
+
+    // Keys in the order they first appear in the base run
+    int counts[VERDICT_COUNT] = {0};
+    int only_base = 0, only_new = 0;
+    uint64_t rng = cfg.seed != 0 ? cfg.seed : 1;
+    char key[KEY_LEN];
+    for (int r = 0; r < base.nrows; r++) {
+        result_key(&base.rows[r], key, sizeof(key));
+        if (!first_with_key(&base, r, key)) {
+            continue;
+        }
+        if (!has_key(&new_set, key)) {
+            only_base++;
+            continue;
+        }
+        int printed_key = FALSE;
+        for (int f = 0; f < cfg.nfields; f++) {
+            int verdict = compare_field(&cfg, &base, &new_set, key, cfg.fields[f], &rng, &printed_key);
+            if (verdict >= 0) {
+                counts[verdict]++;
+            }
+        }
+    }
+    for (int r = 0; r < new_set.nrows; r++) {
+        result_key(&new_set.rows[r], key, sizeof(key));
+        if (first_with_key(&new_set, r, key) && !has_key(&base, key)) {
+            only_new++;
+        }
+    }
+
+    printf("\nSummary: %d slower, %d faster, %d unchanged, %d with too few runs", counts[VERDICT_SLOWER],
+           counts[VERDICT_FASTER], counts[VERDICT_UNCHANGED], counts[VERDICT_TOO_FEW]);
+    if (only_base > 0 || only_new > 0) {
+        printf("; %d measurements only in base, %d only in new", only_base, only_new);
+    }
+    printf("\n");
+
+    results_free(&base);
+    results_free(&new_set);
+    return counts[VERDICT_SLOWER] > 0 ? EXIT_REGRESSION : 0;
+}